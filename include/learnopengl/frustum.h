@@ -0,0 +1,137 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// model space bounding volumes of a mesh: an axis aligned box and a sphere around the box center
+struct Bounds {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // any vertex type with a glm::vec3 Position member
+    template<typename V>
+    static Bounds fromVertices(const V *vertices, size_t count)
+    {
+        Bounds bounds;
+        if(count == 0)
+            return bounds;
+
+        bounds.min = bounds.max = vertices[0].Position;
+        for(size_t i = 1; i < count; i++)
+        {
+            bounds.min = glm::min(bounds.min, vertices[i].Position);
+            bounds.max = glm::max(bounds.max, vertices[i].Position);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        // the sphere around the box center is tighter than half the box diagonal for most meshes
+        float radiusSquared = 0.0f;
+        for(size_t i = 0; i < count; i++)
+        {
+            glm::vec3 offset = vertices[i].Position - bounds.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+
+    static Bounds fromBox(const glm::vec3 &min, const glm::vec3 &max)
+    {
+        Bounds bounds;
+        bounds.min = min;
+        bounds.max = max;
+        bounds.center = (min + max) * 0.5f;
+        bounds.radius = glm::length(max - bounds.center);
+        return bounds;
+    }
+
+    static Bounds merge(const Bounds &a, const Bounds &b)
+    {
+        Bounds bounds;
+        bounds.min = glm::min(a.min, b.min);
+        bounds.max = glm::max(a.max, b.max);
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        bounds.radius = std::max(glm::length(a.center - bounds.center) + a.radius,
+                                 glm::length(b.center - bounds.center) + b.radius);
+        return bounds;
+    }
+};
+
+// meshes submitted and skipped by frustum culling
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culled = 0;
+};
+
+// view frustum as six planes (left, right, bottom, top, near, far) pointing inwards,
+// extracted from a projection * view matrix
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    Frustum() : Frustum(glm::mat4(1.0f))
+    {
+    }
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // glm matrices are column major, m[column][row]
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        for(int i = 0; i < 3; i++)
+        {
+            planes[i * 2]     = row[3] + row[i];
+            planes[i * 2 + 1] = row[3] - row[i];
+        }
+        for(glm::vec4 &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        for(const glm::vec4 &plane : planes)
+            if(glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+
+    bool intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const
+    {
+        for(const glm::vec4 &plane : planes)
+        {
+            // corner of the box furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x,
+                             plane.y >= 0.0f ? max.y : min.y,
+                             plane.z >= 0.0f ? max.z : min.z);
+            if(glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // tests model space bounds placed in the world by a model matrix.
+    // The sphere test rejects most invisible meshes, the box test only runs for the ones it lets through.
+    bool isVisible(const Bounds &bounds, const glm::mat4 &model) const
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        if(!intersectsSphere(center, bounds.radius * scale))
+            return false;
+
+        // world space box around the transformed box (Arvo)
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+        glm::vec3 worldExtent(0.0f);
+        for(int column = 0; column < 3; column++)
+            worldExtent += glm::abs(glm::vec3(model[column])) * extent[column];
+        return intersectsBox(center - worldExtent, center + worldExtent);
+    }
+};
+#endif
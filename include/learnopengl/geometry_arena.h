@@ -0,0 +1,406 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/vertex.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// One vertex buffer, one position only buffer and one index buffer that the static meshes are sub-allocated from,
+// with a VAO over each vertex buffer sharing the index buffer. A mesh in the arena is an allocation of
+// (baseVertex, firstIndex, count): its indices stay relative to its first vertex and are drawn with
+// glDrawElementsBaseVertex, so meshes sharing a program and textures can go out in one
+// glMultiDrawElementsBaseVertex without a VAO switch.
+//
+// Vertices and indices are placed first fit in the holes of freed allocations, then at the top of the buffers.
+// A buffer that runs out is grown in place (its contents are copied out, the storage is reallocated and
+// copied back) so the VAOs keep pointing at the same buffer names. compact() moves the live allocations down
+// over the holes, which only changes the offsets of the allocations because the indices are relative.
+class GeometryArena {
+public:
+    // a range of a buffer, in vertices or indices
+    struct Span {
+        unsigned int offset;
+        unsigned int size;
+    };
+
+    struct Allocation {
+        Span vertices;
+        Span indices;
+        bool live;
+    };
+
+    struct Stats {
+        unsigned int allocations = 0;
+        unsigned int vertexCapacity = 0;
+        unsigned int vertexUsed = 0;
+        unsigned int indexCapacity = 0;
+        unsigned int indexUsed = 0;
+        // holes left by freed allocations below the top of the buffers
+        unsigned int freeSpans = 0;
+        unsigned int holeVertices = 0;
+        unsigned int holeIndices = 0;
+        // 1 - largest free span / free space, 0 when all free space is in one piece
+        float vertexFragmentation = 0.0f;
+        float indexFragmentation = 0.0f;
+        unsigned int grows = 0;
+        unsigned int compactions = 0;
+    };
+
+    // needs a current GL context. Only meshes with the same vertex layout (float Vertex or PackedVertex) and index type go in,
+    // GL_UNSIGNED_SHORT indices fit meshes of up to 65536 vertices because they are relative to the base vertex.
+    explicit GeometryArena(bool packed, GLenum indexType = GL_UNSIGNED_INT, unsigned int vertexCapacity = 1 << 16,
+                           unsigned int indexCapacity = 1 << 18)
+    {
+        packedLayout = packed;
+        elementType = indexType;
+        grows = 0;
+        compactions = 0;
+        vertexHeap.capacity = vertexCapacity;
+        indexHeap.capacity = indexCapacity;
+
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &positionBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (size_t)vertexCapacity * VertexStride(packed), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, positionBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (size_t)vertexCapacity * PositionStride(packed), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (size_t)indexCapacity * IndexSize(indexType), NULL, GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &vao);
+        glGenVertexArrays(1, &positionVao);
+        GLState &state = GLState::get();
+        state.bindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        SetVertexAttributes(packed);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        state.bindVertexArray(positionVao);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        SetPositionAttribute(packed);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        state.bindVertexArray(0);
+    }
+
+    ~GeometryArena()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteVertexArrays(1, &positionVao);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &positionBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        GLState::get().invalidate();
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    bool packed() const { return packedLayout; }
+    GLenum indexType() const { return elementType; }
+    unsigned int vertexArray() const { return vao; }
+    // positions only, the depth pre-pass VAO of the meshes in the arena
+    unsigned int positionVertexArray() const { return positionVao; }
+    unsigned int vertices() const { return vertexBuffer; }
+    unsigned int positions() const { return positionBuffer; }
+    unsigned int indices() const { return indexBuffer; }
+
+    // copies a mesh into the arena and returns its allocation. positions is the position only stream of the vertices,
+    // indexData holds indices of the arena index type.
+    unsigned int allocate(const void *vertexData, const void *positionData, unsigned int vertexCount,
+                          const void *indexData, unsigned int indexCount)
+    {
+        Allocation allocation;
+        allocation.vertices.size = vertexCount;
+        allocation.indices.size = indexCount;
+        allocation.live = true;
+        if(!vertexHeap.allocate(vertexCount, allocation.vertices.offset))
+        {
+            growVertices(vertexHeap.top + vertexCount);
+            vertexHeap.allocate(vertexCount, allocation.vertices.offset);
+        }
+        if(!indexHeap.allocate(indexCount, allocation.indices.offset))
+        {
+            growIndices(indexHeap.top + indexCount);
+            indexHeap.allocate(indexCount, allocation.indices.offset);
+        }
+
+        size_t vertexStride = VertexStride(packedLayout);
+        size_t positionStride = PositionStride(packedLayout);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertices.offset * vertexStride, vertexCount * vertexStride, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, positionBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertices.offset * positionStride, vertexCount * positionStride, positionData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indices.offset * IndexSize(elementType), indexCount * IndexSize(elementType), indexData);
+
+        // ids of freed allocations are handed out again, so unload and reload cycles don't grow the table
+        if(!freeIds.empty())
+        {
+            unsigned int id = freeIds.back();
+            freeIds.pop_back();
+            allocations[id] = allocation;
+            return id;
+        }
+        allocations.push_back(allocation);
+        return allocations.size() - 1;
+    }
+
+    // returns the ranges of an allocation to the arena, the id may be returned by a later allocate()
+    void free(unsigned int id)
+    {
+        Allocation &allocation = allocations[id];
+        if(!allocation.live)
+            return;
+        vertexHeap.release(allocation.vertices);
+        indexHeap.release(allocation.indices);
+        allocation.live = false;
+        freeIds.push_back(id);
+    }
+
+    const Allocation &operator[](unsigned int id) const { return allocations[id]; }
+
+    // moves the live allocations down over the holes, in their current order. The draws read the new offsets
+    // through the allocations, packets recorded before compacting are stale.
+    void compact()
+    {
+        if(vertexHeap.holes.empty() && indexHeap.holes.empty())
+            return;
+
+        std::vector<Move> vertexMoves, indexMoves;
+        std::vector<unsigned int> byVertex, byIndex;
+        for(unsigned int id = 0; id < allocations.size(); id++)
+            if(allocations[id].live)
+            {
+                byVertex.push_back(id);
+                byIndex.push_back(id);
+            }
+        std::sort(byVertex.begin(), byVertex.end(), [this](unsigned int a, unsigned int b) {
+            return allocations[a].vertices.offset < allocations[b].vertices.offset;
+        });
+        std::sort(byIndex.begin(), byIndex.end(), [this](unsigned int a, unsigned int b) {
+            return allocations[a].indices.offset < allocations[b].indices.offset;
+        });
+
+        unsigned int top = 0;
+        for(unsigned int id : byVertex)
+        {
+            Span &span = allocations[id].vertices;
+            vertexMoves.push_back({span.offset, top, span.size});
+            span.offset = top;
+            top += span.size;
+        }
+        vertexHeap.reset(top);
+        top = 0;
+        for(unsigned int id : byIndex)
+        {
+            Span &span = allocations[id].indices;
+            indexMoves.push_back({span.offset, top, span.size});
+            span.offset = top;
+            top += span.size;
+        }
+        indexHeap.reset(top);
+
+        moveRanges(vertexBuffer, VertexStride(packedLayout), vertexMoves, vertexHeap.top);
+        moveRanges(positionBuffer, PositionStride(packedLayout), vertexMoves, vertexHeap.top);
+        moveRanges(indexBuffer, IndexSize(elementType), indexMoves, indexHeap.top);
+        compactions++;
+    }
+
+    Stats stats() const
+    {
+        Stats stats;
+        for(const Allocation &allocation : allocations)
+            if(allocation.live)
+                stats.allocations++;
+        stats.vertexCapacity = vertexHeap.capacity;
+        stats.vertexUsed = vertexHeap.used;
+        stats.indexCapacity = indexHeap.capacity;
+        stats.indexUsed = indexHeap.used;
+        stats.freeSpans = vertexHeap.holes.size() + indexHeap.holes.size();
+        stats.holeVertices = vertexHeap.holeSize();
+        stats.holeIndices = indexHeap.holeSize();
+        stats.vertexFragmentation = vertexHeap.fragmentation();
+        stats.indexFragmentation = indexHeap.fragmentation();
+        stats.grows = grows;
+        stats.compactions = compactions;
+        return stats;
+    }
+
+    // GPU bytes of the three buffers, allocated or not
+    size_t capacityBytes() const
+    {
+        return (size_t)vertexHeap.capacity * (VertexStride(packedLayout) + PositionStride(packedLayout)) +
+               (size_t)indexHeap.capacity * IndexSize(elementType);
+    }
+
+private:
+    // first fit allocator of one buffer. Holes are kept sorted by offset and merged with their neighbours,
+    // a hole that reaches the top is given back to the top.
+    struct Heap {
+        unsigned int capacity = 0;
+        unsigned int top = 0;
+        unsigned int used = 0;
+        std::vector<Span> holes;
+
+        bool allocate(unsigned int size, unsigned int &offset)
+        {
+            for(unsigned int i = 0; i < holes.size(); i++)
+            {
+                if(holes[i].size < size)
+                    continue;
+                offset = holes[i].offset;
+                holes[i].offset += size;
+                holes[i].size -= size;
+                if(holes[i].size == 0)
+                    holes.erase(holes.begin() + i);
+                used += size;
+                return true;
+            }
+            if(capacity - top < size)
+                return false;
+            offset = top;
+            top += size;
+            used += size;
+            return true;
+        }
+
+        void release(const Span &span)
+        {
+            used -= span.size;
+            auto next = std::lower_bound(holes.begin(), holes.end(), span.offset,
+                                         [](const Span &hole, unsigned int offset) { return hole.offset < offset; });
+            auto inserted = holes.insert(next, span);
+            // merge with the following hole, then with the previous one
+            if(inserted + 1 != holes.end() && inserted->offset + inserted->size == (inserted + 1)->offset)
+            {
+                inserted->size += (inserted + 1)->size;
+                holes.erase(inserted + 1);
+            }
+            if(inserted != holes.begin() && (inserted - 1)->offset + (inserted - 1)->size == inserted->offset)
+            {
+                (inserted - 1)->size += inserted->size;
+                inserted = holes.erase(inserted) - 1;
+            }
+            if(inserted->offset + inserted->size == top)
+            {
+                top = inserted->offset;
+                holes.erase(inserted);
+            }
+        }
+
+        // everything below top is allocated
+        void reset(unsigned int newTop)
+        {
+            holes.clear();
+            top = newTop;
+            used = newTop;
+        }
+
+        unsigned int holeSize() const
+        {
+            unsigned int size = 0;
+            for(const Span &hole : holes)
+                size += hole.size;
+            return size;
+        }
+
+        float fragmentation() const
+        {
+            unsigned int available = capacity - used;
+            if(available == 0)
+                return 0.0f;
+            unsigned int largest = capacity - top;
+            for(const Span &hole : holes)
+                largest = std::max(largest, hole.size);
+            return 1.0f - (float)largest / (float)available;
+        }
+    };
+
+    // a copy of size elements from one offset to another
+    struct Move {
+        unsigned int from;
+        unsigned int to;
+        unsigned int size;
+    };
+
+    void growVertices(unsigned int needed)
+    {
+        unsigned int capacity = std::max(needed, vertexHeap.capacity * 2);
+        resize(vertexBuffer, vertexHeap.top * VertexStride(packedLayout), (size_t)capacity * VertexStride(packedLayout));
+        resize(positionBuffer, vertexHeap.top * PositionStride(packedLayout), (size_t)capacity * PositionStride(packedLayout));
+        vertexHeap.capacity = capacity;
+        grows++;
+    }
+
+    void growIndices(unsigned int needed)
+    {
+        unsigned int capacity = std::max(needed, indexHeap.capacity * 2);
+        resize(indexBuffer, indexHeap.top * IndexSize(elementType), (size_t)capacity * IndexSize(elementType));
+        indexHeap.capacity = capacity;
+        grows++;
+    }
+
+    // reallocates the storage of buffer, keeping its first keep bytes and its name
+    static void resize(unsigned int buffer, size_t keep, size_t bytes)
+    {
+        unsigned int copy = keep > 0 ? copyToTemporary(buffer, keep) : 0;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        if(copy == 0)
+            return;
+        glBindBuffer(GL_COPY_READ_BUFFER, copy);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keep);
+        glDeleteBuffers(1, &copy);
+    }
+
+    // copies the first bytes of buffer into a new buffer
+    static unsigned int copyToTemporary(unsigned int buffer, size_t bytes)
+    {
+        unsigned int copy;
+        glGenBuffers(1, &copy);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, copy);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+        return copy;
+    }
+
+    // source and destination of glCopyBufferSubData may not overlap, the moves go through a temporary buffer
+    static void moveRanges(unsigned int buffer, size_t stride, const std::vector<Move> &moves, unsigned int top)
+    {
+        if(top == 0)
+            return;
+        unsigned int packed;
+        glGenBuffers(1, &packed);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, packed);
+        glBufferData(GL_COPY_WRITE_BUFFER, (size_t)top * stride, NULL, GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        for(const Move &move : moves)
+            if(move.size > 0)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, move.from * stride, move.to * stride, move.size * stride);
+        glBindBuffer(GL_COPY_READ_BUFFER, packed);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)top * stride);
+        glDeleteBuffers(1, &packed);
+    }
+
+    bool packedLayout;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum elementType;
+    unsigned int vertexBuffer, positionBuffer, indexBuffer;
+    unsigned int vao, positionVao;
+    Heap vertexHeap, indexHeap;
+    std::vector<Allocation> allocations;
+    // allocations that are no longer live, reused by allocate()
+    std::vector<unsigned int> freeIds;
+    unsigned int grows;
+    unsigned int compactions;
+};
+
+
+#endif //GEOMETRY_ARENA_H
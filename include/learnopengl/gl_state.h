@@ -0,0 +1,303 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// Shadow copy of the GL state the renderer changes every frame: program, VAO, draw framebuffer, the
+// textures bound to each unit, blend/depth/cull enables and the depth and blend functions.
+// Every setter compares against the shadow and only calls GL when the value changes, it returns
+// whether a call was made. Code that changes this state with raw GL calls (texture uploads, VAO setup)
+// has to call invalidate() before the next tracked call.
+class GLState
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+    // value of shadow entries that are not known, the next set always calls GL
+    static const unsigned int UNKNOWN = ~0u;
+
+    // calls made and skipped since the last resetCounters
+    struct Counters {
+        unsigned long issued = 0;
+        unsigned long skipped = 0;
+    };
+
+    static GLState &get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // when enabled every setter compares the shadow against glGet* first and reports mismatches
+    bool validation = false;
+    Counters counters;
+
+    void invalidate()
+    {
+        program = vertexArray = framebuffer = activeUnit = UNKNOWN;
+        for(unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            for(unsigned int target = 0; target < TARGET_COUNT; target++)
+                textures[unit][target] = UNKNOWN;
+        for(int &capability : capabilities)
+            capability = -1;
+        depthFunction = blendSource = blendDestination = blendSourceAlpha = blendDestinationAlpha = UNKNOWN;
+        depthWrite = -1;
+    }
+
+    void resetCounters()
+    {
+        counters = Counters();
+    }
+
+    bool useProgram(unsigned int id)
+    {
+        if(validation)
+            check("program", program, GL_CURRENT_PROGRAM);
+        if(!changed(program, id))
+            return false;
+        glUseProgram(id);
+        return true;
+    }
+
+    bool bindVertexArray(unsigned int id)
+    {
+        if(validation)
+            check("vertex array", vertexArray, GL_VERTEX_ARRAY_BINDING);
+        if(!changed(vertexArray, id))
+            return false;
+        glBindVertexArray(id);
+        return true;
+    }
+
+    // binds both the draw and the read framebuffer, like glBindFramebuffer(GL_FRAMEBUFFER, ...)
+    bool bindFramebuffer(unsigned int id)
+    {
+        if(validation)
+            check("framebuffer", framebuffer, GL_DRAW_FRAMEBUFFER_BINDING);
+        if(!changed(framebuffer, id))
+            return false;
+        glBindFramebuffer(GL_FRAMEBUFFER, id);
+        return true;
+    }
+
+    // target is GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER or GL_TEXTURE_2D_ARRAY
+    bool bindTexture(unsigned int unit, GLenum target, unsigned int id)
+    {
+        unsigned int &bound = textures[unit][targetIndex(target)];
+        if(validation)
+            checkTexture(unit, target, bound);
+        if(!changed(bound, id))
+            return false;
+        activeTexture(unit);
+        glBindTexture(target, id);
+        return true;
+    }
+
+    // cap is GL_BLEND, GL_DEPTH_TEST or GL_CULL_FACE
+    bool setEnabled(GLenum cap, bool enabled)
+    {
+        int &current = capabilities[capabilityIndex(cap)];
+        if(validation)
+            checkCapability(cap);
+        if(current == (int)enabled){
+            counters.skipped++;
+            return false;
+        }
+        current = enabled;
+        counters.issued++;
+        if(enabled)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        return true;
+    }
+
+    bool depthFunc(GLenum function)
+    {
+        if(validation)
+            check("depth function", depthFunction, GL_DEPTH_FUNC);
+        if(!changed(depthFunction, function))
+            return false;
+        glDepthFunc(function);
+        return true;
+    }
+
+    bool depthMask(bool write)
+    {
+        if(validation)
+            checkDepthMask();
+        if(depthWrite == (int)write){
+            counters.skipped++;
+            return false;
+        }
+        depthWrite = write;
+        counters.issued++;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        return true;
+    }
+
+    bool blendFunc(GLenum source, GLenum destination)
+    {
+        return blendFuncSeparate(source, destination, source, destination);
+    }
+
+    bool blendFuncSeparate(GLenum source, GLenum destination, GLenum sourceAlpha, GLenum destinationAlpha)
+    {
+        if(validation){
+            check("blend source", blendSource, GL_BLEND_SRC_RGB);
+            check("blend destination", blendDestination, GL_BLEND_DST_RGB);
+            check("blend source alpha", blendSourceAlpha, GL_BLEND_SRC_ALPHA);
+            check("blend destination alpha", blendDestinationAlpha, GL_BLEND_DST_ALPHA);
+        }
+        if(blendSource == source && blendDestination == destination &&
+           blendSourceAlpha == sourceAlpha && blendDestinationAlpha == destinationAlpha){
+            counters.skipped++;
+            return false;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        blendSourceAlpha = sourceAlpha;
+        blendDestinationAlpha = destinationAlpha;
+        counters.issued++;
+        glBlendFuncSeparate(source, destination, sourceAlpha, destinationAlpha);
+        return true;
+    }
+
+    // compares the whole shadow against glGet*, for a check once per frame
+    void validate()
+    {
+        check("program", program, GL_CURRENT_PROGRAM);
+        check("vertex array", vertexArray, GL_VERTEX_ARRAY_BINDING);
+        check("framebuffer", framebuffer, GL_DRAW_FRAMEBUFFER_BINDING);
+        check("depth function", depthFunction, GL_DEPTH_FUNC);
+        check("blend source", blendSource, GL_BLEND_SRC_RGB);
+        check("blend destination", blendDestination, GL_BLEND_DST_RGB);
+        check("blend source alpha", blendSourceAlpha, GL_BLEND_SRC_ALPHA);
+        check("blend destination alpha", blendDestinationAlpha, GL_BLEND_DST_ALPHA);
+        checkDepthMask();
+        const GLenum caps[] = {GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE};
+        for(GLenum cap : caps)
+            checkCapability(cap);
+        for(unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++){
+            checkTexture(unit, GL_TEXTURE_2D, textures[unit][0]);
+            checkTexture(unit, GL_TEXTURE_CUBE_MAP, textures[unit][1]);
+            checkTexture(unit, GL_TEXTURE_BUFFER, textures[unit][2]);
+            checkTexture(unit, GL_TEXTURE_2D_ARRAY, textures[unit][3]);
+        }
+    }
+
+private:
+    static const unsigned int TARGET_COUNT = 4;
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int framebuffer;
+    unsigned int activeUnit;
+    unsigned int textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+    // -1 unknown, 0 disabled, 1 enabled
+    int capabilities[3];
+    unsigned int depthFunction;
+    int depthWrite;
+    unsigned int blendSource;
+    unsigned int blendDestination;
+    unsigned int blendSourceAlpha;
+    unsigned int blendDestinationAlpha;
+
+    bool changed(unsigned int &shadow, unsigned int value)
+    {
+        if(shadow == value){
+            counters.skipped++;
+            return false;
+        }
+        shadow = value;
+        counters.issued++;
+        return true;
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if(activeUnit == unit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+
+    static unsigned int targetIndex(GLenum target)
+    {
+        return target == GL_TEXTURE_CUBE_MAP ? 1 : target == GL_TEXTURE_BUFFER ? 2 : target == GL_TEXTURE_2D_ARRAY ? 3 : 0;
+    }
+
+    static unsigned int capabilityIndex(GLenum cap)
+    {
+        return cap == GL_BLEND ? 0 : cap == GL_DEPTH_TEST ? 1 : 2;
+    }
+
+    void check(const char *name, unsigned int &shadow, GLenum binding)
+    {
+        if(shadow == UNKNOWN)
+            return;
+        GLint actual = 0;
+        glGetIntegerv(binding, &actual);
+        if((unsigned int)actual != shadow){
+            report(name, shadow, actual);
+            // continue from what GL really has
+            shadow = (unsigned int)actual;
+        }
+    }
+
+    void checkCapability(GLenum cap)
+    {
+        int &shadow = capabilities[capabilityIndex(cap)];
+        if(shadow == -1)
+            return;
+        bool actual = glIsEnabled(cap) == GL_TRUE;
+        if(actual != (bool)shadow){
+            report("capability", shadow, actual);
+            shadow = actual;
+        }
+    }
+
+    void checkDepthMask()
+    {
+        if(depthWrite == -1)
+            return;
+        GLboolean actual;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &actual);
+        if((bool)actual != (bool)depthWrite){
+            report("depth mask", depthWrite, actual);
+            depthWrite = actual == GL_TRUE;
+        }
+    }
+
+    void checkTexture(unsigned int unit, GLenum target, unsigned int &shadow)
+    {
+        if(shadow == UNKNOWN)
+            return;
+        GLint previousUnit = 0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &previousUnit);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        GLint actual = 0;
+        glGetIntegerv(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_BINDING_CUBE_MAP :
+                      target == GL_TEXTURE_BUFFER ? GL_TEXTURE_BINDING_BUFFER :
+                      target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D, &actual);
+        glActiveTexture(previousUnit);
+        if((unsigned int)actual != shadow){
+            std::cout << "ERROR::GL_STATE:: " << (target == GL_TEXTURE_CUBE_MAP ? "cube map" : target == GL_TEXTURE_BUFFER ? "buffer texture" :
+                                                  target == GL_TEXTURE_2D_ARRAY ? "texture array" : "texture") << " of unit " << unit
+                      << " shadow is " << shadow << " but GL has " << actual << std::endl;
+            shadow = (unsigned int)actual;
+        }
+    }
+
+    void report(const char *name, long expected, long actual)
+    {
+        std::cout << "ERROR::GL_STATE:: " << name << " shadow is " << expected << " but GL has " << actual << std::endl;
+    }
+};
+#endif
@@ -5,65 +5,330 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/vertex.h>
+#include <learnopengl/geometry_arena.h>
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-};
-
-
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// texture a mesh refers to, before it is loaded into a GL texture
+struct TextureRef {
+    string type;
+    string path;
+};
+
+// mesh data as imported on the CPU, before anything is uploaded to the GPU
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<TextureRef>   textures;
+    Bounds               bounds;
+    // filled instead of vertices by PackVertices
+    vector<PackedVertex> packedVertices;
+    glm::vec3            positionScale = glm::vec3(1.0f);
+    glm::vec3            positionOffset = glm::vec3(0.0f);
+};
+
+// quantizes the vertices of an imported mesh into packedVertices and releases the float ones.
+// bounds has to contain the mesh, the meshes of a model are packed across the model bounds so they share one decode.
+inline void PackVertices(MeshData &mesh, const Bounds &bounds)
+{
+    // a flat mesh still divides by a non zero extent
+    glm::vec3 extent = bounds.max - bounds.min;
+    for(int axis = 0; axis < 3; axis++)
+        if(extent[axis] <= 0.0f)
+            extent[axis] = 1.0f;
+    mesh.positionScale = extent;
+    mesh.positionOffset = bounds.min;
+
+    auto direction = [](const glm::vec3 &v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
+    };
+
+    mesh.packedVertices.resize(mesh.vertices.size());
+    for(size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const Vertex &vertex = mesh.vertices[i];
+        PackedVertex &packed = mesh.packedVertices[i];
+        glm::vec3 unit = (vertex.Position - mesh.positionOffset) / extent;
+        for(int axis = 0; axis < 3; axis++)
+            packed.Position[axis] = (uint16_t)std::lround(glm::clamp(unit[axis], 0.0f, 1.0f) * 65535.0f);
+        packed.Position[3] = 0;
+
+        glm::vec3 normal = direction(vertex.Normal);
+        glm::vec3 tangent = direction(vertex.Tangent);
+        float handedness = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+        packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+        packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, handedness));
+        packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+    }
+    vector<Vertex>().swap(mesh.vertices);
+}
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, vertices or packedVertices. Empty after releaseCpuData(), the GPU copies and the counts stay.
     vector<Vertex>       vertices;
+    vector<PackedVertex> packedVertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    // GL_UNSIGNED_SHORT when the mesh was uploaded with 16-bit indices, GL_UNSIGNED_INT otherwise
+    GLenum indexType;
+    // decode of packed positions (position = aPos * positionScale + positionOffset), identity for float vertices
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
 
     unsigned int VAO;
+    // positions only, tightly packed, with the same indices. Used by the depth pre-pass.
+    unsigned int positionVAO;
+    // arena the vertices and indices were sub-allocated from, null when the mesh has its own buffers
+    GeometryArena *arena;
+    unsigned int allocation;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // model space bounding volumes, used for frustum culling
+    Bounds bounds;
+    // constructor, pass the arrays with std::move to upload them without copies.
+    // With an arena of the same vertex layout and index type the mesh is allocated from it instead of creating its own buffers.
+    // shortIndices uploads 16-bit indices when the mesh has at most 65536 vertices.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GeometryArena *arena = nullptr,
+         bool shortIndices = false)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        positionScale = glm::vec3(1.0f);
+        positionOffset = glm::vec3(0.0f);
+        this->arena = arena;
+        indexType = shortIndices && this->vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // constructor for vertices quantized by PackVertices
+    Mesh(vector<PackedVertex> packedVertices, const glm::vec3 &positionScale, const glm::vec3 &positionOffset,
+         vector<unsigned int> indices, vector<Texture> textures, GeometryArena *arena = nullptr, bool shortIndices = false)
+    {
+        this->packedVertices = std::move(packedVertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->positionScale = positionScale;
+        this->positionOffset = positionOffset;
+        this->arena = arena;
+        indexType = shortIndices && this->packedVertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        setupMesh();
+    }
+
+    // move only, a mesh owns its GL objects (or its arena allocation) until release() or its destructor.
+    // A moved from mesh owns nothing and draws nothing. Needs the context (and the arena) to still be alive.
+    ~Mesh()
+    {
+        release();
+    }
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh &&other) noexcept
+        : vertexCount(0), indexCount(0), VAO(0), positionVAO(0), arena(nullptr), allocation(0), VBO(0), EBO(0), positionVBO(0)
+    {
+        *this = std::move(other);
+    }
+
+    Mesh& operator=(Mesh &&other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        // a live mesh moved over gives up its own objects first
+        release();
+        vertices = std::move(other.vertices);
+        packedVertices = std::move(other.packedVertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        vertexCount = std::exchange(other.vertexCount, 0u);
+        indexCount = std::exchange(other.indexCount, 0u);
+        indexType = other.indexType;
+        positionScale = other.positionScale;
+        positionOffset = other.positionOffset;
+        VAO = std::exchange(other.VAO, 0u);
+        positionVAO = std::exchange(other.positionVAO, 0u);
+        VBO = std::exchange(other.VBO, 0u);
+        EBO = std::exchange(other.EBO, 0u);
+        positionVBO = std::exchange(other.positionVBO, 0u);
+        arena = std::exchange(other.arena, nullptr);
+        allocation = std::exchange(other.allocation, 0u);
+        glslIdentifierPrefix = std::move(other.glslIdentifierPrefix);
+        bounds = other.bounds;
+        packedLayout = other.packedLayout;
+        samplerLocations = std::move(other.samplerLocations);
+        samplerProgram = std::exchange(other.samplerProgram, 0u);
+        samplerPrefix = std::move(other.samplerPrefix);
+        return *this;
+    }
+
+    bool packed() const { return packedLayout; }
+
+    // deletes the GL objects of the mesh, or gives its vertices and indices back to the arena. Draws nothing afterwards.
+    void release()
+    {
+        if(arena != nullptr)
+            arena->free(allocation);
+        else if(VAO != 0)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteVertexArrays(1, &positionVAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+            glDeleteBuffers(1, &positionVBO);
+            // the deleted names may be handed out again
+            GLState::get().invalidate();
+        }
+        VAO = positionVAO = VBO = EBO = positionVBO = 0;
+        arena = nullptr;
+        allocation = 0;
+        vertexCount = indexCount = 0;
+    }
+
+    // first vertex and first index of the mesh in its buffers, 0 without an arena.
+    // Read at every draw, compacting the arena moves them.
+    int baseVertex() const
+    {
+        return arena != nullptr ? (int)(*arena)[allocation].vertices.offset : 0;
+    }
+
+    unsigned int firstIndex() const
+    {
+        return arena != nullptr ? (*arena)[allocation].indices.offset : 0;
+    }
+
+    // a new VAO over the buffers of the mesh with the same attributes as VAO, for callers that add attributes
+    // of their own (instance batches) without touching a VAO other meshes share. The caller deletes it.
+    unsigned int createVertexArray() const
+    {
+        unsigned int vao;
+        glGenVertexArrays(1, &vao);
+        GLState::get().bindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, arena != nullptr ? arena->vertices() : VBO);
+        SetVertexAttributes(packedLayout);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena != nullptr ? arena->indices() : EBO);
+        GLState::get().bindVertexArray(0);
+        return vao;
+    }
+
+    // frees the CPU copies of the vertices and indices, draws only need the GPU buffers and the counts
+    void releaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<PackedVertex>().swap(packedVertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    bool hasCpuData() const { return !indices.empty(); }
+
+    // bytes of the vertex buffer and the position only stream on the GPU
+    size_t vertexBytes() const
+    {
+        if(packedLayout)
+            return (size_t)vertexCount * (sizeof(PackedVertex) + 4 * sizeof(uint16_t));
+        return (size_t)vertexCount * (sizeof(Vertex) + sizeof(glm::vec3));
+    }
+
+    // what the same vertices take as float Vertex
+    size_t floatVertexBytes() const
+    {
+        return (size_t)vertexCount * (sizeof(Vertex) + sizeof(glm::vec3));
+    }
+
+    size_t indexBytes() const
+    {
+        return (size_t)indexCount * IndexSize(indexType);
+    }
+
+    // bytes of the vertex and index copies held in system memory
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + packedVertices.capacity() * sizeof(PackedVertex) +
+               indices.capacity() * sizeof(unsigned int);
+    }
+
+    size_t gpuBytes() const
+    {
+        return vertexBytes() + indexBytes();
+    }
+
+    // sets the position decode uniforms, every shader that reads mesh positions has them
+    void setPositionDecode(Shader &shader) const
+    {
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+    }
+
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
+        setSamplers(shader);
+        setPositionDecode(shader);
+
+        // bind appropriate textures, the state cache skips the ones already bound
+        GLState &state = GLState::get();
+        for(unsigned int i = 0; i < textures.size(); i++)
+            state.bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+
+        // draw mesh
+        state.bindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)((size_t)firstIndex() * IndexSize(indexType)),
+                                 baseVertex());
+    }
+
+    // points the sampler of every texture (prefix + texture_diffuseN etc.) at texture unit i
+    void setSamplers(Shader &shader)
+    {
+        // sampler locations only change with the program or the name prefix, not per frame
+        if(samplerProgram != shader.ID || samplerPrefix != glslIdentifierPrefix || !Shader::locationCacheEnabled())
+            resolveSamplerLocations(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+            shader.setInt(samplerLocations[i], i);
+    }
+
+private:
+    // render data
+    unsigned int VBO, EBO, positionVBO;
+    bool packedLayout;
+    // sampler uniform location of every texture, valid for samplerProgram and samplerPrefix
+    vector<int> samplerLocations;
+    unsigned int samplerProgram = 0;
+    std::string samplerPrefix;
+
+    // builds the sampler names (prefix + texture_diffuseN etc.) and looks up their locations in the shader
+    void resolveSamplerLocations(Shader &shader)
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerLocations.resize(textures.size());
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -76,64 +341,72 @@ public:
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerLocations[i] = shader.uniformLocation(glslIdentifierPrefix + name + number);
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        samplerProgram = shader.ID;
+        samplerPrefix = glslIdentifierPrefix;
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        packedLayout = !packedVertices.empty();
+        vertexCount = packedLayout ? packedVertices.size() : vertices.size();
+        indexCount = indices.size();
+        const void *vertexData = packedLayout ? (const void*)packedVertices.data() : (const void*)vertices.data();
+
+        // position only stream, a third of the bytes per vertex (two fifths packed) for depth only passes
+        size_t positionStride = PositionStride(packedLayout);
+        vector<unsigned char> positions(vertexCount * positionStride);
+        for(unsigned int i = 0; i < vertexCount; i++)
+        {
+            const void *position = packedLayout ? (const void*)packedVertices[i].Position : (const void*)&vertices[i].Position;
+            memcpy(&positions[i * positionStride], position, positionStride);
+        }
+
+        // the indices are uploaded as they are or narrowed to 16 bits
+        vector<uint16_t> shortIndices;
+        if(indexType == GL_UNSIGNED_SHORT)
+            shortIndices.assign(indices.begin(), indices.end());
+        const void *indexData = indexType == GL_UNSIGNED_SHORT ? (const void*)shortIndices.data() : (const void*)indices.data();
+
+        // meshes of the other vertex layout or index type keep their own buffers
+        if(arena != nullptr && (arena->packed() != packedLayout || arena->indexType() != indexType))
+            arena = nullptr;
+        if(arena != nullptr)
+        {
+            allocation = arena->allocate(vertexData, positions.data(), vertexCount, indexData, indexCount);
+            VAO = arena->vertexArray();
+            positionVAO = arena->positionVertexArray();
+            VBO = EBO = positionVBO = 0;
+            return;
+        }
+        allocation = 0;
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * IndexSize(indexType), indexData, GL_STATIC_DRAW);
+
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * VertexStride(packedLayout), vertexData, GL_STATIC_DRAW);
+        SetVertexAttributes(packedLayout);
 
+        // position only stream, tightly packed, with the same indices
+        glGenVertexArrays(1, &positionVAO);
+        glGenBuffers(1, &positionVBO);
+        GLState::get().bindVertexArray(positionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        SetPositionAttribute(packedLayout);
+
+        GLState::get().bindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,302 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Versioned on-disk cache of already imported meshes. Every model gets one flat binary file that holds
+// the post-processed Vertex/index arrays and the texture references of all its meshes, so a warm start
+// only has to memory-map the file instead of running Assimp again.
+//
+// File layout (all values little endian, every block padded to 4 bytes):
+//   Header | source path | per mesh: MeshHeader, vertices, indices, texture references
+// A file is only used when magic, version, import flags, optimization (MeshOptimizer), vertex size and the
+// source file's mtime and size all match, otherwise it is treated as a miss and rewritten after the Assimp import.
+class MeshCache
+{
+public:
+    static const uint32_t MAGIC   = 0x4853454D; // "MESH"
+    static const uint32_t VERSION = 2;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t importFlags;
+        uint32_t vertexSize;
+        int64_t  sourceMtime;
+        int64_t  sourceSize;
+        uint32_t meshCount;
+        uint32_t pathLength;
+        // 1 when the meshes were stored after MeshOptimizer::optimize
+        uint32_t optimized;
+        uint32_t padding;
+    };
+
+    struct MeshHeader {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t padding;
+    };
+
+    // read-only view of a single cached mesh, pointing straight into the mapped file
+    struct MeshView {
+        const Vertex*       vertices;
+        uint32_t            vertexCount;
+        const unsigned int* indices;
+        uint32_t            indexCount;
+        vector<TextureRef>  textures;
+    };
+
+    // memory mapping of one cache file, unmapped when it goes out of scope
+    class Mapping
+    {
+    public:
+        Mapping() : data(nullptr), size(0) {}
+        ~Mapping() { release(); }
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        bool map(const string &path)
+        {
+            release();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+                ::close(fd);
+                return false;
+            }
+            void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (ptr == MAP_FAILED)
+                return false;
+            data = (const unsigned char*)ptr;
+            size = (size_t)st.st_size;
+            return true;
+        }
+
+        void release()
+        {
+            if (data)
+                munmap((void*)data, size);
+            data = nullptr;
+            size = 0;
+        }
+
+        const unsigned char *data;
+        size_t size;
+    };
+
+    // directory the cache files are written to, relative to the working directory like the model paths
+    static string directory()
+    {
+        return "resources/cache";
+    }
+
+    static string cachePathFor(const string &sourcePath)
+    {
+        // FNV-1a of the source path keeps file names short and flat, the full path is also
+        // stored in the file so a hash collision is detected as a miss
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : sourcePath) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return directory() + "/" + name + ".meshcache";
+    }
+
+    static bool sourceStat(const string &sourcePath, int64_t &mtime, int64_t &size)
+    {
+        struct stat st;
+        if (stat(sourcePath.c_str(), &st) != 0)
+            return false;
+        mtime = (int64_t)st.st_mtime;
+        size = (int64_t)st.st_size;
+        return true;
+    }
+
+    // maps the cache file for sourcePath and parses it into views over the mapping.
+    // returns false on any mismatch or truncation, in which case the caller falls back to Assimp.
+    static bool read(const string &sourcePath, unsigned int importFlags, bool optimized, Mapping &mapping, vector<MeshView> &meshes)
+    {
+        int64_t mtime, size;
+        if (!sourceStat(sourcePath, mtime, size))
+            return false;
+        if (!mapping.map(cachePathFor(sourcePath)))
+            return false;
+
+        size_t offset = 0;
+        Header header;
+        if (!readPod(mapping, offset, header))
+            return false;
+        if (header.magic != MAGIC || header.version != VERSION || header.importFlags != importFlags
+            || header.optimized != (optimized ? 1u : 0u) || header.vertexSize != sizeof(Vertex) || header.sourceMtime != mtime || header.sourceSize != size)
+            return false;
+        if (header.pathLength != sourcePath.size() || !fits(mapping, offset, header.pathLength)
+            || memcmp(mapping.data + offset, sourcePath.data(), header.pathLength) != 0)
+            return false;
+        offset = align(offset + header.pathLength);
+
+        meshes.clear();
+        meshes.reserve(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            MeshHeader meshHeader;
+            if (!readPod(mapping, offset, meshHeader))
+                return false;
+
+            MeshView view;
+            size_t vertexBytes = (size_t)meshHeader.vertexCount * sizeof(Vertex);
+            size_t indexBytes = (size_t)meshHeader.indexCount * sizeof(unsigned int);
+            if (!fits(mapping, offset, vertexBytes))
+                return false;
+            view.vertices = (const Vertex*)(mapping.data + offset);
+            view.vertexCount = meshHeader.vertexCount;
+            offset = align(offset + vertexBytes);
+            if (!fits(mapping, offset, indexBytes))
+                return false;
+            view.indices = (const unsigned int*)(mapping.data + offset);
+            view.indexCount = meshHeader.indexCount;
+            offset = align(offset + indexBytes);
+
+            for (uint32_t t = 0; t < meshHeader.textureCount; t++)
+            {
+                TextureRef ref;
+                if (!readString(mapping, offset, ref.type) || !readString(mapping, offset, ref.path))
+                    return false;
+                view.textures.push_back(ref);
+            }
+            meshes.push_back(view);
+        }
+        return true;
+    }
+
+    // writes the cache file for sourcePath. The file is written under a temporary name and renamed
+    // so a crash mid-write never leaves a truncated file that passes the header check.
+    static bool write(const string &sourcePath, unsigned int importFlags, bool optimized, const vector<MeshData> &meshes)
+    {
+        int64_t mtime, size;
+        if (!sourceStat(sourcePath, mtime, size))
+            return false;
+        mkdir(directory().c_str(), 0755);
+
+        string path = cachePathFor(sourcePath);
+        string tmpPath = path + ".tmp";
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out)
+        {
+            cout << "ERROR::MESH_CACHE:: could not write " << tmpPath << endl;
+            return false;
+        }
+
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.importFlags = importFlags;
+        header.vertexSize = sizeof(Vertex);
+        header.sourceMtime = mtime;
+        header.sourceSize = size;
+        header.meshCount = (uint32_t)meshes.size();
+        header.pathLength = (uint32_t)sourcePath.size();
+        header.optimized = optimized ? 1 : 0;
+        header.padding = 0;
+        out.write((const char*)&header, sizeof(header));
+        writePadded(out, sourcePath.data(), sourcePath.size());
+
+        for (const MeshData &mesh : meshes)
+        {
+            MeshHeader meshHeader;
+            meshHeader.vertexCount = (uint32_t)mesh.vertices.size();
+            meshHeader.indexCount = (uint32_t)mesh.indices.size();
+            meshHeader.textureCount = (uint32_t)mesh.textures.size();
+            meshHeader.padding = 0;
+            out.write((const char*)&meshHeader, sizeof(meshHeader));
+            writePadded(out, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            writePadded(out, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            for (const TextureRef &texture : mesh.textures)
+            {
+                writeString(out, texture.type);
+                writeString(out, texture.path);
+            }
+        }
+
+        out.close();
+        if (!out || rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            cout << "ERROR::MESH_CACHE:: could not write " << path << endl;
+            remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // removes the cache file of a model, the next load goes through Assimp again
+    static void invalidate(const string &sourcePath)
+    {
+        remove(cachePathFor(sourcePath).c_str());
+    }
+
+private:
+    static size_t align(size_t offset)
+    {
+        return (offset + 3) & ~(size_t)3;
+    }
+
+    static bool fits(const Mapping &mapping, size_t offset, size_t bytes)
+    {
+        return offset <= mapping.size && bytes <= mapping.size - offset;
+    }
+
+    template<typename T>
+    static bool readPod(const Mapping &mapping, size_t &offset, T &value)
+    {
+        if (!fits(mapping, offset, sizeof(T)))
+            return false;
+        memcpy(&value, mapping.data + offset, sizeof(T));
+        offset = align(offset + sizeof(T));
+        return true;
+    }
+
+    static bool readString(const Mapping &mapping, size_t &offset, string &value)
+    {
+        uint32_t length;
+        if (!readPod(mapping, offset, length) || !fits(mapping, offset, length))
+            return false;
+        value.assign((const char*)mapping.data + offset, length);
+        offset = align(offset + length);
+        return true;
+    }
+
+    static void writePadded(ofstream &out, const void *data, size_t bytes)
+    {
+        static const char zeros[4] = {0, 0, 0, 0};
+        if (bytes)
+            out.write((const char*)data, bytes);
+        out.write(zeros, align(bytes) - bytes);
+    }
+
+    static void writeString(ofstream &out, const string &value)
+    {
+        uint32_t length = (uint32_t)value.size();
+        out.write((const char*)&length, sizeof(length));
+        writePadded(out, value.data(), value.size());
+    }
+};
+#endif
@@ -0,0 +1,231 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <learnopengl/mesh.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Import time optimization of the index and vertex order of a mesh, run before the mesh is cached:
+//   1. identical vertices are merged, Assimp emits one vertex per face corner for most OBJ files
+//   2. triangles are reordered for the post-transform vertex cache with Tipsify
+//      (Sander, Nehab, Barczak: "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+//   3. vertices are reordered by first use, so the vertex fetch walks the buffer front to back
+//
+// ACMR (cache misses per triangle, 0.5 at best, 3 without any reuse) and ATVR (cache misses per vertex,
+// 1 at best) are measured on a FIFO cache of CACHE_SIZE entries.
+class MeshOptimizer
+{
+public:
+    // entries of the simulated post-transform cache, and the cache size Tipsify optimizes for
+    static const unsigned int CACHE_SIZE = 16;
+
+    struct Report {
+        unsigned int verticesBefore = 0;
+        unsigned int verticesAfter = 0;
+        unsigned int triangles = 0;
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+        float atvrBefore = 0.0f;
+        float atvrAfter = 0.0f;
+        // false when the mesh was only measured (read from the cache already optimized, or optimization off)
+        bool optimized = false;
+    };
+
+    // optimizes the mesh in place and recomputes its bounds
+    static Report optimize(MeshData &mesh)
+    {
+        Report report = analyze(mesh);
+        report.verticesBefore = mesh.vertices.size();
+        report.acmrBefore = report.acmrAfter;
+        report.atvrBefore = report.atvrAfter;
+        if(mesh.indices.empty())
+            return report;
+
+        deduplicateVertices(mesh);
+        mesh.indices = tipsify(mesh.indices, mesh.vertices.size(), CACHE_SIZE);
+        reorderVertices(mesh);
+        mesh.bounds = Bounds::fromVertices(mesh.vertices.data(), mesh.vertices.size());
+
+        Report after = analyze(mesh);
+        report.verticesAfter = after.verticesAfter;
+        report.acmrAfter = after.acmrAfter;
+        report.atvrAfter = after.atvrAfter;
+        report.optimized = true;
+        return report;
+    }
+
+    // measures the mesh as it is, the before values are the same as the after values
+    static Report analyze(const MeshData &mesh)
+    {
+        Report report;
+        report.verticesBefore = report.verticesAfter = mesh.vertices.size();
+        report.triangles = mesh.indices.size() / 3;
+
+        // FIFO: a vertex is in the cache while fewer than CACHE_SIZE misses happened since it was loaded
+        vector<unsigned int> loaded(mesh.vertices.size(), 0);
+        unsigned int time = CACHE_SIZE + 1;
+        unsigned int misses = 0;
+        for(unsigned int index : mesh.indices)
+            if(time - loaded[index] > CACHE_SIZE)
+            {
+                loaded[index] = time++;
+                misses++;
+            }
+        if(report.triangles > 0)
+            report.acmrBefore = report.acmrAfter = (float)misses / report.triangles;
+        if(!mesh.vertices.empty())
+            report.atvrBefore = report.atvrAfter = (float)misses / mesh.vertices.size();
+        return report;
+    }
+
+private:
+    // merges vertices with the same bytes through an open addressing hash table of vertex indices
+    static void deduplicateVertices(MeshData &mesh)
+    {
+        const unsigned int EMPTY = ~0u;
+        size_t tableSize = 1;
+        while(tableSize < mesh.vertices.size() * 2)
+            tableSize *= 2;
+        vector<unsigned int> table(tableSize, EMPTY);
+        vector<unsigned int> remap(mesh.vertices.size());
+        vector<Vertex> unique;
+        unique.reserve(mesh.vertices.size());
+
+        for(unsigned int i = 0; i < mesh.vertices.size(); i++)
+        {
+            const Vertex &vertex = mesh.vertices[i];
+            // FNV-1a over the bytes, Vertex is all floats without padding
+            uint64_t hash = 14695981039346656037ull;
+            const unsigned char *bytes = (const unsigned char*)&vertex;
+            for(size_t b = 0; b < sizeof(Vertex); b++)
+                hash = (hash ^ bytes[b]) * 1099511628211ull;
+
+            size_t slot = hash & (tableSize - 1);
+            while(table[slot] != EMPTY && memcmp(&unique[table[slot]], &vertex, sizeof(Vertex)) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+            if(table[slot] == EMPTY)
+            {
+                table[slot] = unique.size();
+                unique.push_back(vertex);
+            }
+            remap[i] = table[slot];
+        }
+
+        for(unsigned int &index : mesh.indices)
+            index = remap[index];
+        mesh.vertices.swap(unique);
+    }
+
+    // Tipsify: fans around the vertex that was emitted last and is still in the cache, and jumps to a vertex
+    // of the recent triangles (or the next vertex with triangles left) when the fan is done
+    static vector<unsigned int> tipsify(const vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize)
+    {
+        unsigned int triangleCount = indices.size() / 3;
+
+        // triangles of every vertex, and how many of them are not emitted yet
+        vector<unsigned int> live(vertexCount, 0);
+        for(unsigned int index : indices)
+            live[index]++;
+        vector<unsigned int> offsets(vertexCount + 1, 0);
+        for(unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        vector<unsigned int> adjacency(indices.size());
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        vector<unsigned int> cacheTime(vertexCount, 0);
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> deadEnd;
+        vector<unsigned int> candidates;
+        vector<unsigned int> output;
+        output.reserve(indices.size());
+        unsigned int time = cacheSize + 1;
+        unsigned int cursor = 0;
+        int fanning = nextUnfinished(live, cursor);
+
+        while(fanning >= 0)
+        {
+            candidates.clear();
+            for(unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+            {
+                unsigned int triangle = adjacency[a];
+                if(emitted[triangle])
+                    continue;
+                for(unsigned int corner = 0; corner < 3; corner++)
+                {
+                    unsigned int v = indices[triangle * 3 + corner];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if(time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // the candidate that stays in the cache while its remaining triangles are emitted, oldest first
+            int best = -1;
+            int bestPriority = -1;
+            for(unsigned int v : candidates)
+            {
+                if(live[v] == 0)
+                    continue;
+                int priority = 0;
+                if(time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                    priority = time - cacheTime[v];
+                if(priority > bestPriority)
+                {
+                    best = v;
+                    bestPriority = priority;
+                }
+            }
+            // dead end: the most recent vertex with triangles left, then any vertex with triangles left
+            while(best < 0 && !deadEnd.empty())
+            {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if(live[v] > 0)
+                    best = v;
+            }
+            if(best < 0)
+                best = nextUnfinished(live, cursor);
+            fanning = best;
+        }
+        return output;
+    }
+
+    // first vertex from cursor on with triangles left, -1 when all are emitted. cursor only moves forward.
+    static int nextUnfinished(const vector<unsigned int> &live, unsigned int &cursor)
+    {
+        for(; cursor < live.size(); cursor++)
+            if(live[cursor] > 0)
+                return cursor;
+        return -1;
+    }
+
+    // renumbers the vertices in the order the indices first use them, unused vertices are dropped
+    static void reorderVertices(MeshData &mesh)
+    {
+        const unsigned int UNUSED = ~0u;
+        vector<unsigned int> remap(mesh.vertices.size(), UNUSED);
+        unsigned int next = 0;
+        for(unsigned int &index : mesh.indices)
+        {
+            if(remap[index] == UNUSED)
+                remap[index] = next++;
+            index = remap[index];
+        }
+
+        vector<Vertex> reordered(next);
+        for(unsigned int v = 0; v < mesh.vertices.size(); v++)
+            if(remap[v] != UNUSED)
+                reordered[remap[v]] = mesh.vertices[v];
+        mesh.vertices.swap(reordered);
+    }
+};
+#endif
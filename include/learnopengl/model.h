@@ -11,16 +11,30 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
 #include <learnopengl/shader.h>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <map>
 #include <vector>
 using namespace std;
 
+// pixels decoded by stb_image, not uploaded to the GPU yet. data is released with stbi_image_free.
+struct ImageData {
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int nrComponents = 0;
+};
+
+ImageData DecodeImage(const string &filename, bool flip = false);
+unsigned int TextureFromImage(ImageData &image, const string &filename);
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
 
@@ -33,6 +47,39 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // bounding volumes around all meshes, in model space
+    Bounds bounds;
+    // meshes imported by import() and not uploaded yet
+    vector<MeshData> imported;
+    // load statistics, filled in by import() and upload()
+    bool loadedFromCache = false;
+    double loadSeconds = 0.0;
+    // quantizes the vertices at import (PackVertices), set before import()
+    bool packVertices = false;
+    // merges and reorders the vertices and triangles at import (MeshOptimizer), set before import()
+    bool optimizeMeshes = false;
+    // uploads 16-bit indices for meshes of up to 65536 vertices, set before upload()
+    bool shortIndices = false;
+    // vertex cache statistics of every imported mesh, in the order of meshes
+    vector<MeshOptimizer::Report> meshReports;
+    // keeps the CPU copies of the vertices and indices after upload (collision, picking), set before upload()
+    bool retainCpuData = false;
+    // static models share the buffers of an arena instead of one VAO, VBO and EBO per mesh, set before upload()
+    GeometryArena *arena = nullptr;
+
+    // GPU bytes of the meshes (vertices, what they would take as float Vertex, indices) and the bytes held on the CPU
+    struct MemoryReport {
+        size_t vertexBytes = 0;
+        size_t floatVertexBytes = 0;
+        size_t indexBytes = 0;
+        size_t gpuBytes = 0;
+        size_t cpuBytes = 0;
+    };
+
+    // default constructor, the model is filled later through import() and upload() (see AssetLoader).
+    Model() : gammaCorrection(false)
+    {
+    }
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -47,29 +94,180 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws the meshes whose bounds, placed by the model matrix, intersect the frustum
+    void Draw(Shader &shader, const glm::mat4 &model, const Frustum &frustum, CullStats &stats)
+    {
+        ForEachVisibleMesh(model, frustum, stats, [&shader](Mesh &mesh) { mesh.Draw(shader); });
+    }
+
+    // calls visit for every mesh that passes the frustum test
+    template<typename F>
+    void ForEachVisibleMesh(const glm::mat4 &model, const Frustum &frustum, CullStats &stats, F visit)
+    {
+        if(!frustum.isVisible(bounds, model))
+        {
+            stats.culled += meshes.size();
+            return;
+        }
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            // a single mesh has the model's bounds, which were just tested
+            if(meshes.size() > 1 && !frustum.isVisible(meshes[i].bounds, model))
+            {
+                stats.culled++;
+                continue;
+            }
+            visit(meshes[i]);
+            stats.drawn++;
+        }
+    }
+
+    MemoryReport memoryReport() const
+    {
+        MemoryReport report;
+        for(const Mesh &mesh : meshes)
+        {
+            report.vertexBytes += mesh.vertexBytes();
+            report.floatVertexBytes += mesh.floatVertexBytes();
+            report.indexBytes += mesh.indexBytes();
+            report.gpuBytes += mesh.gpuBytes();
+            report.cpuBytes += mesh.cpuBytes();
+        }
+        return report;
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
+
+    // imports the model into CPU memory only (mesh cache or ASSIMP). Makes no GL calls, so it can run on a worker thread.
+    bool import(string const &path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        size_t firstMesh = imported.size();
+        // try the binary mesh cache first, Assimp is only needed on a miss
+        loadedFromCache = loadFromCache(path, importFlags);
+        if(!loadedFromCache)
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return false;
+            }
+
+            // process ASSIMP's root node recursively
+            imported.reserve(imported.size() + scene->mNumMeshes);
+            processNode(scene->mRootNode, scene);
+        }
+        // the cache holds the meshes optimized, a warm load only measures them
+        for(size_t i = firstMesh; i < imported.size(); i++)
+            meshReports.push_back(optimizeMeshes && !loadedFromCache ? MeshOptimizer::optimize(imported[i])
+                                                                     : MeshOptimizer::analyze(imported[i]));
+        if(!loadedFromCache)
+            MeshCache::write(path, importFlags, optimizeMeshes, imported);
+        // the cache keeps float vertices, both paths are packed here.
+        // All meshes are quantized across the model bounds, one decode lets them share a multi-draw.
+        if(packVertices && !imported.empty())
+        {
+            Bounds modelBounds = imported[0].bounds;
+            for(const MeshData &mesh : imported)
+                modelBounds = Bounds::merge(modelBounds, mesh.bounds);
+            for(MeshData &mesh : imported)
+                if(mesh.packedVertices.empty())
+                    PackVertices(mesh, modelBounds);
+        }
+        loadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // full paths of all textures the imported meshes refer to, each listed once
+    vector<string> importedTexturePaths() const
+    {
+        vector<string> paths;
+        for(const MeshData &mesh : imported)
+            for(const TextureRef &ref : mesh.textures)
+            {
+                string path = directory + '/' + ref.path;
+                if(std::find(paths.begin(), paths.end(), path) == paths.end())
+                    paths.push_back(path);
+            }
+        return paths;
+    }
+
+    // uploads the imported meshes and their textures, has to run on the thread owning the GL context.
+    // textures found in decodedImages (keyed by full path) are uploaded from there, the rest is loaded from disk.
+    void upload(map<string, ImageData> *decodedImages = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        meshes.reserve(meshes.size() + imported.size());
+        for(MeshData &mesh : imported)
+        {
+            vector<Texture> textures;
+            textures.reserve(mesh.textures.size());
+            for(const TextureRef &ref : mesh.textures)
+                textures.push_back(loadTexture(ref.path.c_str(), ref.type, decodedImages));
+            // the imported arrays are moved into the mesh, imported is cleared below
+            if(!mesh.packedVertices.empty())
+                meshes.emplace_back(std::move(mesh.packedVertices), mesh.positionScale, mesh.positionOffset,
+                                    std::move(mesh.indices), std::move(textures), arena, shortIndices);
+            else
+                meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), arena, shortIndices);
+            meshes.back().bounds = mesh.bounds;
+            if(!retainCpuData)
+                meshes.back().releaseCpuData();
+            bounds = meshes.size() == 1 ? mesh.bounds : Bounds::merge(bounds, mesh.bounds);
+        }
+        imported.clear();
+        loadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // unloads the meshes: their GL buffers are deleted, or their ranges go back to the arena.
+    // The textures stay loaded, import() and upload() again reload the model and reuse them.
+    void release()
+    {
+        for(Mesh &mesh : meshes)
+            mesh.release();
+        meshes.clear();
+        meshReports.clear();
+        bounds = Bounds();
+    }
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        if(import(path))
+            upload();
+    }
+
+    // reads the meshes from the memory-mapped cache file, returns false on a cache miss
+    bool loadFromCache(string const &path, unsigned int importFlags)
+    {
+        MeshCache::Mapping mapping;
+        vector<MeshCache::MeshView> views;
+        if(!MeshCache::read(path, importFlags, optimizeMeshes, mapping, views))
+            return false;
+
+        imported.reserve(imported.size() + views.size());
+        for(const MeshCache::MeshView &view : views)
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            MeshData mesh;
+            mesh.vertices.assign(view.vertices, view.vertices + view.vertexCount);
+            mesh.indices.assign(view.indices, view.indices + view.indexCount);
+            mesh.textures = view.textures;
+            mesh.bounds = Bounds::fromVertices(view.vertices, view.vertexCount);
+            imported.push_back(std::move(mesh));
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
-
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -81,7 +279,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -91,65 +289,53 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        // data to fill, written in place: every array is allocated once at its final size and moved out
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<TextureRef> &textures = data.textures;
+        vertices.reserve(mesh->mNumVertices);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+            vertices.emplace_back();
+            Vertex &vertex = vertices.back();
             // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
+            vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
             // normals
             if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
+                vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            else
+                vertex.Normal = glm::vec3(0.0f);
             // texture coordinates
             if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
             {
-                glm::vec2 vec;
                 // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
                 // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
                 // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
+                vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
                 // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
             }
             else
+            {
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
-
-
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+            }
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // the faces are triangulated, so three indices each
+        indices.reserve((size_t)mesh->mNumFaces * 3);
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -159,101 +345,124 @@ private:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-        aiColor3D color(0.0f, 0.0f, 0.0f);
-        material->Get(AI_MATKEY_COLOR_AMBIENT, color);
-
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // height: texture_heightN
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
+
+        // return the extracted mesh data, the GL objects are created in upload()
+        data.bounds = Bounds::fromVertices(vertices.data(), vertices.size());
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // appends all material textures of a given type to textures.
+    // the required info is stored as a TextureRef struct, the textures are loaded in upload().
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const string &typeName, vector<TextureRef> &textures)
     {
-        vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        unsigned int count = mat->GetTextureCount(type);
+        textures.reserve(textures.size() + count);
+        for(unsigned int i = 0; i < count; i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            TextureRef ref;
+            ref.type = typeName;
+            ref.path = str.C_Str();
+            textures.push_back(std::move(ref));
+        }
+    }
+
+    // returns the texture at the given path relative to the model directory, loading it only once per model.
+    Texture loadTexture(const char *path, const string &typeName, map<string, ImageData> *decodedImages)
+    {
+        // check if texture was loaded before and if so, reuse it: skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(std::strcmp(textures_loaded[j].path.data(), path) == 0)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                // a texture with the same filepath has already been loaded, continue with the next one. (optimization)
+                return textures_loaded[j];
             }
         }
-        return textures;
+        // if texture hasn't been loaded already, load it (or upload it if it was decoded ahead of time)
+        Texture texture;
+        string filename = this->directory + '/' + path;
+        if(decodedImages && decodedImages->count(filename))
+            texture.id = TextureFromImage((*decodedImages)[filename], filename);
+        else
+            texture.id = TextureFromFile(path, this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
 
-inline unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// decodes an image file with stb_image. Rows are flipped here instead of through stbi_set_flip_vertically_on_load
+// because that flag is global and images are decoded on several threads at once.
+inline ImageData DecodeImage(const string &filename, bool flip)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    ImageData image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    if (image.data && flip)
+    {
+        size_t rowSize = (size_t)image.width * image.nrComponents;
+        vector<unsigned char> row(rowSize);
+        for (int y = 0; y < image.height / 2; y++)
+        {
+            unsigned char *top = image.data + y * rowSize;
+            unsigned char *bottom = image.data + (image.height - 1 - y) * rowSize;
+            memcpy(row.data(), top, rowSize);
+            memcpy(top, bottom, rowSize);
+            memcpy(bottom, row.data(), rowSize);
+        }
+    }
+    return image;
+}
 
+// uploads a decoded image as a mipmapped texture and frees the pixels
+inline unsigned int TextureFromImage(ImageData &image, const string &filename)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.nrComponents == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.nrComponents == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.nrComponents == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
     }
+    stbi_image_free(image.data);
+    image.data = nullptr;
 
     return textureID;
 }
+
+inline unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
+
+    ImageData image = DecodeImage(filename);
+    return TextureFromImage(image, filename);
+}
 #endif
@@ -8,7 +8,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <common.h>
+#include <learnopengl/gl_state.h>
 
 struct PointLight {
     glm::vec3 position;
@@ -48,9 +50,29 @@ class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // locations of all active uniforms, filled by program introspection right after linking
+    std::unordered_map<std::string, int> uniformLocations;
+
+    // number of uniform related driver calls, used by the uniform benchmark
+    struct CallCounters {
+        unsigned long locationQueries = 0;
+        unsigned long uniformCalls = 0;
+    };
+    static CallCounters &counters()
+    {
+        static CallCounters callCounters;
+        return callCounters;
+    }
+    // when disabled every setter calls glGetUniformLocation again, like before the cache existed
+    static bool &locationCacheEnabled()
+    {
+        static bool enabled = true;
+        return enabled;
+    }
+    // constructor generates the shader on the fly. defines (e.g. "#define HORIZONTAL\n") are inserted
+    // right after the #version line of every stage, to compile specialized variants of one source.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const char* defines = nullptr)
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -99,6 +121,12 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if(defines != nullptr)
+        {
+            insertDefines(vertexCode, defines);
+            insertDefines(fragmentCode, defines);
+            insertDefines(geometryCode, defines);
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -131,6 +159,7 @@ public:
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        cacheUniformLocations();
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -142,69 +171,200 @@ public:
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::get().useProgram(ID);
+    }
+    // returns the location of a uniform, -1 if the program has no such active uniform.
+    // resolve locations once and use the location based setters below on hot paths.
+    // ------------------------------------------------------------------------
+    int uniformLocation(const std::string &name) const
+    {
+        if (!locationCacheEnabled())
+        {
+            counters().locationQueries++;
+            return glGetUniformLocation(ID, name.c_str());
+        }
+        auto location = uniformLocations.find(name);
+        return location != uniformLocations.end() ? location->second : -1;
+    }
+    // connects a uniform block of the program to a binding point, blocks the program doesn't use are skipped
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(uniformLocation(name), value);
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(uniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(uniformLocation(name), value);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(uniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(uniformLocation(name), value);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(uniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniformLocation(name), mat);
+    }
+    // location based uniform functions, no string handling or allocation
+    // ------------------------------------------------------------------------
+    void setBool(int location, bool value) const
+    {
+        counters().uniformCalls++;
+        glUniform1i(location, (int)value);
+    }
+    void setInt(int location, int value) const
+    {
+        counters().uniformCalls++;
+        glUniform1i(location, value);
+    }
+    void setFloat(int location, float value) const
+    {
+        counters().uniformCalls++;
+        glUniform1f(location, value);
+    }
+    void setFloatArray(const std::string &name, const float *values, int count) const
+    {
+        counters().uniformCalls++;
+        glUniform1fv(uniformLocation(name), count, values);
+    }
+    void setVec2(int location, const glm::vec2 &value) const
+    {
+        counters().uniformCalls++;
+        glUniform2fv(location, 1, &value[0]);
+    }
+    void setVec2(int location, float x, float y) const
+    {
+        counters().uniformCalls++;
+        glUniform2f(location, x, y);
+    }
+    void setVec3(int location, const glm::vec3 &value) const
+    {
+        counters().uniformCalls++;
+        glUniform3fv(location, 1, &value[0]);
+    }
+    void setVec3(int location, float x, float y, float z) const
+    {
+        counters().uniformCalls++;
+        glUniform3f(location, x, y, z);
+    }
+    void setVec4(int location, const glm::vec4 &value) const
+    {
+        counters().uniformCalls++;
+        glUniform4fv(location, 1, &value[0]);
+    }
+    void setVec4(int location, float x, float y, float z, float w) const
+    {
+        counters().uniformCalls++;
+        glUniform4f(location, x, y, z, w);
+    }
+    void setMat2(int location, const glm::mat2 &mat) const
+    {
+        counters().uniformCalls++;
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(int location, const glm::mat3 &mat) const
+    {
+        counters().uniformCalls++;
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(int location, const glm::mat4 &mat) const
+    {
+        counters().uniformCalls++;
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
     }
 
 
 private:
+    // inserts the defines right after the #version line, or at the top when the code has none
+    // ------------------------------------------------------------------------
+    static void insertDefines(std::string &code, const char *defines)
+    {
+        if(code.empty())
+            return;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if(lineEnd == std::string::npos)
+            code.insert(0, defines);
+        else
+            code.insert(lineEnd + 1, defines);
+    }
+    // queries all active uniforms of the linked program and stores their locations.
+    // arrays are stored under "name", "name[0]", "name[1]", ... so every spelling used by the setters is found.
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLchar name[256];
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, sizeof(name), &length, &size, &type, name);
+            std::string uniformName(name, length);
+            uniformLocations[uniformName] = glGetUniformLocation(ID, name);
+
+            size_t bracket = uniformName.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == uniformName.size())
+            {
+                std::string baseName = uniformName.substr(0, bracket);
+                uniformLocations[baseName] = uniformLocations[uniformName];
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,100 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+};
+
+// quantized Vertex, 20 bytes instead of 56.
+// Position is unorm16 across the model bounds, the shaders decode it with positionScale and positionOffset.
+// Normal and Tangent are snorm 2_10_10_10, the 2 bit w of the tangent is the sign of the bitangent
+// (the shaders rebuild it as cross(N, T)). TexCoords are two halfs.
+struct PackedVertex {
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t Tangent;
+    uint32_t TexCoords;
+};
+
+// bytes per vertex of the full vertex buffer and of the position only stream the depth pre-pass reads
+inline size_t VertexStride(bool packed)
+{
+    return packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+inline size_t PositionStride(bool packed)
+{
+    return packed ? 4 * sizeof(uint16_t) : sizeof(glm::vec3);
+}
+
+// bytes of one GL_UNSIGNED_SHORT or GL_UNSIGNED_INT index
+inline size_t IndexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// attribute pointers of the bound VAO into the bound GL_ARRAY_BUFFER, starting at vertex 0 of the buffer
+inline void SetVertexAttributes(bool packed)
+{
+    if(packed)
+    {
+        // normalized integers read as floats, the shaders only decode the position
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+        return;
+    }
+
+    // A great thing about structs is that their memory layout is sequential for all its items.
+    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+    // again translates to 3/2 floats which translates to a byte array.
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+// attribute 0 of the bound VAO into a tightly packed position stream in the bound GL_ARRAY_BUFFER
+inline void SetPositionAttribute(bool packed)
+{
+    glEnableVertexAttribArray(0);
+    if(packed)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, PositionStride(true), (void*)0);
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, PositionStride(false), (void*)0);
+}
+
+
+#endif //VERTEX_H
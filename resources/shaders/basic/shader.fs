@@ -17,51 +17,77 @@ struct DirLight {
     vec3 specular;
 };
 
+// members ordered so every float fills the padding after a vec3 (std140)
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+struct RoomLight {
+    vec3 Position;
+    vec3 Color;
 };
 
+// the block keeps the island light for the coin shader, point lights here come from the clusters
 #define NR_POINT_LIGHTS 1
 
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
+};
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
 uniform Material material;
 
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// Clustered point lights (ClusteredLights). Every light is 4 texels of clusterLights laid out like PointLight,
+// clusterGrid holds the (offset, count) of every cluster in clusterIndices.
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterTileSize;
+uniform float clusterScale;
+uniform float clusterBias;
+
 
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+uvec2 FindCluster(vec3 fragPos);
+PointLight FetchPointLight(int index);
 
 void main()
 {
@@ -71,9 +97,10 @@ void main()
 
     //directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    //point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    //point lights of this cluster
+    uvec2 cluster = FindCluster(FragPos);
+    for(uint i = 0u; i < cluster.y; i++)
+        result += CalcPointLight(FetchPointLight(int(texelFetch(clusterIndices, int(cluster.x + i)).r)), norm, FragPos, viewDir);
     //spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
 
@@ -156,3 +183,29 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
 }
+
+// (offset, count) of the cluster fragPos lies in
+uvec2 FindCluster(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale - clusterBias), 0, CLUSTER_SLICES - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    return texelFetch(clusterGrid, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 t0 = texelFetch(clusterLights, index * 4);
+    vec4 t1 = texelFetch(clusterLights, index * 4 + 1);
+    vec4 t2 = texelFetch(clusterLights, index * 4 + 2);
+    vec4 t3 = texelFetch(clusterLights, index * 4 + 3);
+    PointLight light;
+    light.position = t0.xyz;
+    light.constant = t0.w;
+    light.ambient = t1.xyz;
+    light.linear = t1.w;
+    light.diffuse = t2.xyz;
+    light.quadratic = t2.w;
+    light.specular = t3.xyz;
+    return light;
+}
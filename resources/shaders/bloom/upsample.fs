@@ -0,0 +1,31 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D srcTexture;
+// tent filter radius in texture coordinates
+uniform vec2 filterRadius;
+
+void main()
+{
+    float x = filterRadius.x;
+    float y = filterRadius.y;
+
+    // 3x3 tent filter:
+    //  1   | 1 2 1 |
+    // -- * | 2 4 2 |
+    // 16   | 1 2 1 |
+    vec3 result = texture(srcTexture, TexCoords).rgb * 4.0;
+    result += (texture(srcTexture, TexCoords + vec2(-x, 0.0)).rgb +
+               texture(srcTexture, TexCoords + vec2( x, 0.0)).rgb +
+               texture(srcTexture, TexCoords + vec2(0.0, -y)).rgb +
+               texture(srcTexture, TexCoords + vec2(0.0,  y)).rgb) * 2.0;
+    result += texture(srcTexture, TexCoords + vec2(-x, -y)).rgb +
+              texture(srcTexture, TexCoords + vec2( x, -y)).rgb +
+              texture(srcTexture, TexCoords + vec2(-x,  y)).rgb +
+              texture(srcTexture, TexCoords + vec2( x,  y)).rgb;
+
+    // alpha is only read by the blend unit, the blend factor comes from glBlendColor
+    FragColor = vec4(result / 16.0, 1.0);
+}
@@ -1,32 +1,31 @@
 #version 330 core
+// compiled once with HORIZONTAL and once with VERTICAL defined, MAX_TAPS comes from GaussianBlur
 out vec4 FragColor;
 
 in vec2 TexCoords;
 
 uniform sampler2D image;
 
-uniform bool horizontal;
-uniform float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
+// weights[0] is the center texel, every other tap is a bilinear fetch between two texels
+// at offsets[i] texels, it stands for both of them
+uniform float weights[MAX_TAPS];
+uniform float offsets[MAX_TAPS];
+uniform int tapCount;
 
 void main()
-{             
+{
      vec2 tex_offset = 1.0 / textureSize(image, 0); // gets size of single texel
-     vec3 result = texture(image, TexCoords).rgb * weight[0];
-     if(horizontal)
+#ifdef HORIZONTAL
+     vec2 direction = vec2(tex_offset.x, 0.0);
+#else
+     vec2 direction = vec2(0.0, tex_offset.y);
+#endif
+     vec3 result = texture(image, TexCoords).rgb * weights[0];
+     for(int i = 1; i < tapCount; ++i)
      {
-         for(int i = 1; i < 5; ++i)
-         {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-         }
-     }
-     else
-     {
-         for(int i = 1; i < 5; ++i)
-         {
-             result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-             result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-         }
+         vec2 offset = direction * offsets[i];
+         result += texture(image, TexCoords + offset).rgb * weights[i];
+         result += texture(image, TexCoords - offset).rgb * weights[i];
      }
      FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+}
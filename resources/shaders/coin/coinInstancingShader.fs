@@ -17,31 +17,42 @@ struct DirLight {
     vec3 specular;
 };
 
+// members ordered so every float fills the padding after a vec3 (std140)
 struct PointLight {
     vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
     float constant;
+    vec3 ambient;
     float linear;
+    vec3 diffuse;
     float quadratic;
+    vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+struct RoomLight {
+    vec3 Position;
+    vec3 Color;
+};
+
+#define NR_POINT_LIGHTS 1
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
 };
 
 struct Material {
@@ -53,9 +64,7 @@ struct Material {
 };
 
 uniform Material material;
-uniform PointLight pointLight;
 uniform SpotLight spotlight;
-uniform DirLight dirlight;
 
 uniform vec3 viewPosition;
 
@@ -133,8 +142,8 @@ void main() {
     normal = normalize(normal * 2.0 - 1.0);
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
     
-    vec3 result = CalcDirLight(dirlight, normal, viewDir);
-    result += CalcPointLight(pointLight, normal, viewDir, TangentLightPos);
+    vec3 result = CalcDirLight(dirLight, normal, viewDir);
+    result += CalcPointLight(pointLights[0], normal, viewDir, TangentLightPos);
     result += CalcSpotLight(spotlight, normal, viewDir, TangentLightPos, TangentLightDir);
 
    //vec3 result = texture(material.texture_diffuse1, TexCoords).rgb;
@@ -3,7 +3,6 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
 layout (location = 5) in mat4 aInstanceMatrix;
 
 out vec3 FragPos;
@@ -14,14 +13,66 @@ out vec3 TangentLightDir;
 out vec3 TangentViewPos;
 out vec3 TangentFragPos;
 
-uniform mat4 projection;
-uniform mat4 view;
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// members ordered so every float fills the padding after a vec3 (std140)
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+struct RoomLight {
+    vec3 Position;
+    vec3 Color;
+};
+
+#define NR_POINT_LIGHTS 1
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
+};
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
 uniform vec3 lightDir;
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
 
 void main() {
-    FragPos = vec3(aInstanceMatrix * vec4(aPos, 1.0));
+    vec3 position = aPos * positionScale + positionOffset;
+    FragPos = vec3(aInstanceMatrix * vec4(position, 1.0));
     TexCoords = aTexCoords;
 
     mat3 normalMatrix = transpose(inverse(mat3(aInstanceMatrix)));
@@ -31,7 +82,7 @@ void main() {
     vec3 B = cross(N, T);
 
     mat3 TBN = transpose(mat3(T, B, N));
-    TangentLightPos = TBN * lightPos;
+    TangentLightPos = TBN * pointLights[0].position;
 
     TangentViewPos = TBN * viewPos;
     TangentFragPos = TBN * FragPos;
@@ -40,5 +91,5 @@ void main() {
 
     TangentLightDir = TBN * lightDir;
 
-    gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0);
+    gl_Position = projection * view * aInstanceMatrix * vec4(position, 1.0);
 }
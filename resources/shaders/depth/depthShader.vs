@@ -3,7 +3,22 @@ layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
 
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+#ifdef SINGLE_FACE
+// one cube face per draw, the transform the geometry shader would do happens here
+uniform mat4 shadowMatrix;
+out vec4 FragPos;
+#endif
+
 void main()
 {
-    gl_Position = model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    vec3 position = aPos * positionScale + positionOffset;
+#ifdef SINGLE_FACE
+    FragPos = model * vec4(position, 1.0);
+    gl_Position = shadowMatrix * FragPos;
+#else
+    gl_Position = model * vec4(position, 1.0);
+#endif
+}
@@ -1,11 +1,36 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
 
 in vec2 TexCoords;
 
+#ifdef INSTANCED
+in vec4 InstanceColor;
+flat in float InstanceLayer;
+
+uniform sampler2DArray textureLayers;
+#else
 uniform sampler2D texture1;
+#endif
+// weighted blended transparency: the outputs go to RenderTargets::oitBuffers instead of the scene
+uniform bool weightedOit;
 
 void main()
 {
-    FragColor = texture(texture1, TexCoords);
+#ifdef INSTANCED
+    vec4 color = texture(textureLayers, vec3(TexCoords, InstanceLayer)) * InstanceColor;
+#else
+    vec4 color = texture(texture1, TexCoords);
+#endif
+    if(!weightedOit){
+        FragColor = color;
+        BrightColor = vec4(0.0, 0.0, 0.0, color.a);
+        return;
+    }
+
+    // weight function of McGuire and Bavoil, closer and more opaque surfaces count more
+    float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+    // the color adds up, alpha multiplies the revealage by (1 - alpha)
+    FragColor = vec4(color.rgb * color.a * weight, color.a);
+    BrightColor = vec4(color.a * weight, 0.0, 0.0, 0.0);
 }
@@ -4,12 +4,35 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+#ifdef INSTANCED
+// InstanceBatch attributes, the layer picks the diamond color from the texture array
+layout (location = 5) in mat4 aInstanceMatrix;
+layout (location = 9) in vec4 aInstanceColor;
+layout (location = 10) in float aInstanceLayer;
+
+out vec4 InstanceColor;
+flat out float InstanceLayer;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 void main()
 {
+    vec3 position = aPos * positionScale + positionOffset;
+#ifdef INSTANCED
+    mat4 model = aInstanceMatrix;
+    InstanceColor = aInstanceColor;
+    InstanceLayer = aInstanceLayer;
+#endif
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
@@ -17,51 +17,96 @@ struct DirLight {
     vec3 specular;
 };
 
+// members ordered so every float fills the padding after a vec3 (std140)
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+struct RoomLight {
+    vec3 Position;
+    vec3 Color;
 };
 
+// the block keeps the island light for the coin shader, point lights here come from the clusters
 #define NR_POINT_LIGHTS 1
 
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
+};
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
 uniform Material material;
 
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// Clustered point lights (ClusteredLights). Every light is 4 texels of clusterLights laid out like PointLight,
+// clusterGrid holds the (offset, count) of every cluster in clusterIndices.
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterTileSize;
+uniform float clusterScale;
+uniform float clusterBias;
 
+// Point light shadows (PointShadows), distance to the light / far_plane in a depth cubemap.
+// SHADOW_PCF_SAMPLES is the filter size: 1 is a single hard edged lookup, up to 20 taps
+// are spread over a disk of pcfRadius (at the far plane, it grows with the view distance).
+#define SHADOW_PCF_SAMPLES 20
+
+uniform samplerCube shadowMap;
+uniform bool shadows;
+uniform vec3 shadowLightPos;
+uniform float far_plane;
+uniform float pcfRadius;
+
+const vec3 sampleOffsetDirections[20] = vec3[]
+(
+   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
+   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+float ShadowCalculation(vec3 fragPos, vec3 viewDir);
+uvec2 FindCluster(vec3 fragPos);
+PointLight FetchPointLight(int index);
 
 void main()
 {
@@ -72,9 +117,14 @@ void main()
 
     //directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    //point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    //point lights of this cluster, light 0 is the island light and casts shadows
+    uvec2 cluster = FindCluster(FragPos);
+    for(uint i = 0u; i < cluster.y; i++)
+    {
+        int index = int(texelFetch(clusterIndices, int(cluster.x + i)).r);
+        float shadow = index == 0 && shadows ? ShadowCalculation(FragPos, viewDir) : 0.0;
+        result += CalcPointLight(FetchPointLight(index), norm, FragPos, viewDir, shadow);
+    }
     //spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
 
@@ -105,7 +155,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     //Blinn-Phong
@@ -125,7 +175,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
-    return (ambient + diffuse + specular);
+    return (ambient + (1.0 - shadow) * (diffuse + specular));
 }
 
 // calculates the color when using a spot light.
@@ -155,3 +205,55 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
 }
+
+// fraction of the PCF taps that are occluded from shadowLightPos
+float ShadowCalculation(vec3 fragPos, vec3 viewDir)
+{
+    vec3 fragToLight = fragPos - shadowLightPos;
+    float currentDepth = length(fragToLight);
+    // nothing was drawn past the far plane
+    if(currentDepth >= far_plane)
+        return 0.0;
+    float bias = 0.15;
+#if SHADOW_PCF_SAMPLES <= 1
+    float closestDepth = texture(shadowMap, fragToLight).r * far_plane;
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+#else
+    float viewDistance = length(viewPos - fragPos);
+    float diskRadius = pcfRadius * (1.0 + viewDistance / far_plane);
+    float shadow = 0.0;
+    for(int i = 0; i < SHADOW_PCF_SAMPLES && i < 20; ++i)
+    {
+        float closestDepth = texture(shadowMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r * far_plane;
+        if(currentDepth - bias > closestDepth)
+            shadow += 1.0;
+    }
+    return shadow / float(min(SHADOW_PCF_SAMPLES, 20));
+#endif
+}
+
+// (offset, count) of the cluster fragPos lies in
+uvec2 FindCluster(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale - clusterBias), 0, CLUSTER_SLICES - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    return texelFetch(clusterGrid, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 t0 = texelFetch(clusterLights, index * 4);
+    vec4 t1 = texelFetch(clusterLights, index * 4 + 1);
+    vec4 t2 = texelFetch(clusterLights, index * 4 + 2);
+    vec4 t3 = texelFetch(clusterLights, index * 4 + 3);
+    PointLight light;
+    light.position = t0.xyz;
+    light.constant = t0.w;
+    light.ambient = t1.xyz;
+    light.linear = t1.w;
+    light.diffuse = t2.xyz;
+    light.quadratic = t2.w;
+    light.specular = t3.xyz;
+    return light;
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+in vec2 TexCoords;
+
+// written by the transparent pass (diamondShader.fs with weightedOit)
+uniform sampler2D accumulation;
+uniform sampler2D weights;
+
+// blended over the opaque scene with (1 - alpha, alpha), alpha is the revealage
+void main()
+{
+    vec4 accum = texture(accumulation, TexCoords);
+    float revealage = accum.a;
+    // nothing transparent was drawn here
+    if(revealage >= 1.0)
+        discard;
+
+    vec3 color = accum.rgb / max(texture(weights, TexCoords).r, 1e-5);
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    FragColor = vec4(color, revealage);
+    BrightColor = vec4(brightness > 1.0 ? color : vec3(0.0), revealage);
+}
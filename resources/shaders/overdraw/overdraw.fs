@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+// color of the stencil count this quad is drawn for
+uniform vec3 color;
+
+void main()
+{
+    FragColor = vec4(color, 1.0);
+    BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+// bloom composite, tonemapping and the sharpen kernel in one pass, straight into the default framebuffer.
+// Does what bloom/bloom.fs followed by sharpen/effect.fs do without the RGBA16F buffer in between:
+// with sharpening on, the composite is evaluated for each of the nine taps instead of being read back.
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+uniform sampler2D bloomBlur;
+uniform bool bloom;
+uniform bool hdr;
+uniform float exposure;
+uniform bool effect;
+
+const float gamma = 2.2;
+const float offset = 1.0 / 300.0;
+
+vec3 composite(vec2 uv)
+{
+    vec3 hdrColor = texture(scene, uv).rgb;
+    if(bloom)
+        hdrColor += texture(bloomBlur, uv).rgb; // additive blending
+    if(hdr)
+        hdrColor = vec3(1.0) - exp(-hdrColor * exposure);
+    return pow(hdrColor, vec3(1.0 / gamma));
+}
+
+void main()
+{
+    if (!effect) {
+        FragColor = vec4(composite(TexCoords), 1.0);
+        return;
+    }
+
+    // same taps and kernel as sharpen/effect.fs: the corner taps have weight 0 and are skipped,
+    // and like there the tap above is used twice where the one to the right would be
+    vec3 color = composite(TexCoords) * 5.0;
+    color -= composite(TexCoords + vec2(0.0, offset)) * 2.0;
+    color -= composite(TexCoords + vec2(-offset, 0.0));
+    color -= composite(TexCoords + vec2(0.0, -offset));
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth only, color writes are off during the pre-pass
+void main()
+{
+}
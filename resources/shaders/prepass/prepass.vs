@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+
+// decode of packed mesh positions (PackedVertex), identity for float vertices
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// the lit pass tests its depth with GL_EQUAL against this one, model_shader.vs and basic/shader.vs
+// compute gl_Position with the same expression
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = aPos * positionScale + positionOffset;
+    vec3 FragPos = vec3(model * vec4(position, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -7,14 +7,87 @@ in VS_OUT {
     vec2 TexCoords;
 } fs_in;
 
-struct Light {
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// members ordered so every float fills the padding after a vec3 (std140)
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+struct RoomLight {
     vec3 Position;
     vec3 Color;
 };
 
-uniform Light lights;
+#define NR_POINT_LIGHTS 1
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
+};
+
 uniform sampler2D diffuseTexture;
-uniform vec3 viewPos;
+
+// shadows of the room light, see model_shader.fs
+#define SHADOW_PCF_SAMPLES 20
+
+uniform samplerCube shadowMap;
+uniform bool shadows;
+uniform float far_plane;
+uniform float pcfRadius;
+
+const vec3 sampleOffsetDirections[20] = vec3[]
+(
+   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
+   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
+
+float ShadowCalculation(vec3 fragPos)
+{
+    vec3 fragToLight = fragPos - roomLight.Position;
+    float currentDepth = length(fragToLight);
+    if(currentDepth >= far_plane)
+        return 0.0;
+    float bias = 0.15;
+    float shadow = 0.0;
+    for(int i = 0; i < SHADOW_PCF_SAMPLES && i < 20; ++i)
+    {
+        float closestDepth = texture(shadowMap, fragToLight + sampleOffsetDirections[i] * pcfRadius).r * far_plane;
+        if(currentDepth - bias > closestDepth)
+            shadow += 1.0;
+    }
+    return shadow / float(min(SHADOW_PCF_SAMPLES, 20));
+}
 
 void main()
 {           
@@ -26,13 +99,15 @@ void main()
     vec3 lighting = vec3(0.0);
 
         // diffuse
-        vec3 lightDir = normalize(lights.Position - fs_in.FragPos);
+        vec3 lightDir = normalize(roomLight.Position - fs_in.FragPos);
         float diff = max(dot(lightDir, normal), 0.0);
-        vec3 diffuse = lights.Color * diff * color;
+        vec3 diffuse = roomLight.Color * diff * color;
         vec3 result = diffuse;        
         // attenuation (use quadratic as we have gamma correction)
-        float distance = length(fs_in.FragPos - lights.Position);
+        float distance = length(fs_in.FragPos - roomLight.Position);
         result *= 1.0 / (distance * distance);
+        if(shadows)
+            result *= 1.0 - ShadowCalculation(fs_in.FragPos);
         lighting += result;
                 
 
@@ -8,11 +8,55 @@ in VS_OUT {
     vec2 TexCoords;
 } fs_in;
 
-uniform vec3 lightColor;
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// members ordered so every float fills the padding after a vec3 (std140)
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+struct RoomLight {
+    vec3 Position;
+    vec3 Color;
+};
+
+#define NR_POINT_LIGHTS 1
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    RoomLight roomLight;
+};
 
 void main()
 {
-    FragColor = vec4(lightColor, 1.0);
+    FragColor = vec4(roomLight.Color, 1.0);
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     if(brightness > 1.0)
         BrightColor = vec4(FragColor.rgb, 1.0);
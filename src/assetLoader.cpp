@@ -0,0 +1,232 @@
+#include "assetLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+#include "renderer.h"
+
+static double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AssetLoader::AssetLoader(unsigned int threadCount)
+{
+    stopping = false;
+    pending = 0;
+    startTime = now();
+    wallSeconds = 0.0;
+
+    threadCount = std::max(threadCount, 1u);
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&AssetLoader::workerLoop, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void AssetLoader::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void AssetLoader::pushUpload(const std::string &name, double cpuSeconds, std::function<void()> upload)
+{
+    {
+        std::lock_guard<std::mutex> lock(uploadMutex);
+        uploads.push_back({name, cpuSeconds, std::move(upload)});
+    }
+    uploadAvailable.notify_one();
+}
+
+void AssetLoader::workerLoop()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void AssetLoader::loadTexture(const std::string &path, bool gammaCorrection, bool flip, unsigned int *textureID)
+{
+    pending++;
+    submit([this, path, gammaCorrection, flip, textureID] {
+        double start = now();
+        std::shared_ptr<ImageData> image = std::make_shared<ImageData>(DecodeImage(path, flip));
+        pushUpload(path, now() - start, [image, path, gammaCorrection, textureID] {
+            *textureID = Renderer::uploadTexture(*image, path.c_str(), gammaCorrection);
+        });
+    });
+}
+
+void AssetLoader::loadCubemap(const std::vector<std::string> &faces, unsigned int *textureID)
+{
+    // every face is decoded by its own job, the last one to finish queues the upload
+    struct CubemapJob {
+        std::vector<ImageData> images;
+        std::atomic<unsigned int> remaining;
+        std::atomic<long long> cpuNanoseconds;
+    };
+    std::shared_ptr<CubemapJob> cubemap = std::make_shared<CubemapJob>();
+    cubemap->images.resize(faces.size());
+    cubemap->remaining = (unsigned int)faces.size();
+    cubemap->cpuNanoseconds = 0;
+
+    pending++;
+    for (unsigned int i = 0; i < faces.size(); i++) {
+        submit([this, cubemap, faces, i, textureID] {
+            double start = now();
+            cubemap->images[i] = DecodeImage(faces[i]);
+            cubemap->cpuNanoseconds += (long long)((now() - start) * 1e9);
+            if (--cubemap->remaining == 0) {
+                pushUpload("cubemap " + faces[0], cubemap->cpuNanoseconds * 1e-9, [cubemap, faces, textureID] {
+                    *textureID = Renderer::uploadCubemap(cubemap->images, faces);
+                });
+            }
+        });
+    }
+}
+
+void AssetLoader::loadModel(const std::string &path, Model *model)
+{
+    // the model is imported by one job, its textures are then decoded by one job each
+    struct ModelJob {
+        std::map<std::string, ImageData> images;
+        std::mutex imagesMutex;
+        std::atomic<unsigned int> remaining;
+        std::atomic<long long> cpuNanoseconds;
+    };
+
+    pending++;
+    models.push_back({path, model});
+    submit([this, path, model] {
+        double start = now();
+        bool imported = model->import(path);
+        std::shared_ptr<ModelJob> job = std::make_shared<ModelJob>();
+        job->cpuNanoseconds = (long long)((now() - start) * 1e9);
+
+        std::vector<std::string> texturePaths;
+        if (imported)
+            texturePaths = model->importedTexturePaths();
+
+        auto queueUpload = [this, path, model, job] {
+            pushUpload(path, job->cpuNanoseconds * 1e-9, [model, job] {
+                model->upload(&job->images);
+            });
+        };
+
+        if (texturePaths.empty()) {
+            queueUpload();
+            return;
+        }
+
+        job->remaining = (unsigned int)texturePaths.size();
+        for (const std::string &texturePath : texturePaths) {
+            submit([job, texturePath, queueUpload] {
+                double start = now();
+                ImageData image = DecodeImage(texturePath);
+                {
+                    std::lock_guard<std::mutex> lock(job->imagesMutex);
+                    job->images[texturePath] = image;
+                }
+                job->cpuNanoseconds += (long long)((now() - start) * 1e9);
+                if (--job->remaining == 0)
+                    queueUpload();
+            });
+        }
+    });
+}
+
+void AssetLoader::finish()
+{
+    while (pending > 0) {
+        Upload upload;
+        {
+            std::unique_lock<std::mutex> lock(uploadMutex);
+            uploadAvailable.wait(lock, [this] { return !uploads.empty(); });
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+
+        double start = now();
+        upload.upload();
+        timings.push_back({upload.name, upload.cpuSeconds, now() - start});
+        pending--;
+    }
+    wallSeconds = now() - startTime;
+}
+
+void AssetLoader::printReport() const
+{
+    double cpuTotal = 0.0;
+    double uploadTotal = 0.0;
+
+    std::printf("Asset loading (%u worker threads)\n", (unsigned int)workers.size());
+    std::printf("%-70s %10s %10s\n", "asset", "cpu [ms]", "upload [ms]");
+    for (const Timing &timing : timings) {
+        std::printf("%-70s %10.2f %10.2f\n", timing.name.c_str(), timing.cpuSeconds * 1000.0, timing.uploadSeconds * 1000.0);
+        cpuTotal += timing.cpuSeconds;
+        uploadTotal += timing.uploadSeconds;
+    }
+    std::printf("%-70s %10.2f %10.2f\n", "total", cpuTotal * 1000.0, uploadTotal * 1000.0);
+    std::printf("Wall time: %.2f ms\n", wallSeconds * 1000.0);
+}
+
+void AssetLoader::printMeshReport() const
+{
+    std::printf("%-70s %10s %10s %10s %10s %10s\n", "model", "vertex [KB]", "as float", "index [KB]", "gpu [KB]", "cpu [KB]");
+    Model::MemoryReport total;
+    for (const std::pair<std::string, Model*> &entry : models) {
+        Model::MemoryReport report = entry.second->memoryReport();
+        std::printf("%-70s %10.1f %10.1f %10.1f %10.1f %10.1f\n", entry.first.c_str(), report.vertexBytes / 1024.0,
+                    report.floatVertexBytes / 1024.0, report.indexBytes / 1024.0, report.gpuBytes / 1024.0, report.cpuBytes / 1024.0);
+        total.vertexBytes += report.vertexBytes;
+        total.floatVertexBytes += report.floatVertexBytes;
+        total.indexBytes += report.indexBytes;
+        total.gpuBytes += report.gpuBytes;
+        total.cpuBytes += report.cpuBytes;
+    }
+    std::printf("%-70s %10.1f %10.1f %10.1f %10.1f %10.1f\n", "total", total.vertexBytes / 1024.0,
+                total.floatVertexBytes / 1024.0, total.indexBytes / 1024.0, total.gpuBytes / 1024.0, total.cpuBytes / 1024.0);
+
+    // vertex cache statistics before and after the optimizer when it ran on this load
+    std::printf("%-70s %18s %10s %16s %16s %6s\n", "mesh", "vertices", "triangles", "ACMR", "ATVR", "index");
+    for (const std::pair<std::string, Model*> &entry : models) {
+        const Model &model = *entry.second;
+        for (unsigned int i = 0; i < model.meshReports.size() && i < model.meshes.size(); i++) {
+            const MeshOptimizer::Report &report = model.meshReports[i];
+            std::string name = entry.first + " #" + std::to_string(i);
+            unsigned int indexBits = model.meshes[i].indexType == GL_UNSIGNED_SHORT ? 16 : 32;
+            if (report.optimized)
+                std::printf("%-70s %8u -> %6u %10u %6.3f -> %6.3f %6.3f -> %6.3f %6u\n", name.c_str(), report.verticesBefore,
+                            report.verticesAfter, report.triangles, report.acmrBefore, report.acmrAfter,
+                            report.atvrBefore, report.atvrAfter, indexBits);
+            else
+                std::printf("%-70s %18u %10u %16.3f %16.3f %6u\n", name.c_str(), report.verticesAfter, report.triangles,
+                            report.acmrAfter, report.atvrAfter, indexBits);
+        }
+    }
+}
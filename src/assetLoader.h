@@ -0,0 +1,72 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <learnopengl/model.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads textures, cubemaps and models on a pool of worker threads.
+// Workers only decode images (stb_image) and import meshes (mesh cache / Assimp) into CPU memory.
+// Every finished asset is handed to an upload queue that the GL thread drains in finish(),
+// which is where glTexImage2D/glBufferData happen.
+class AssetLoader {
+public:
+    explicit AssetLoader(unsigned int threadCount = std::thread::hardware_concurrency());
+    ~AssetLoader();
+
+    // the GL handle / model is only valid after finish() returned
+    void loadTexture(const std::string &path, bool gammaCorrection, bool flip, unsigned int *textureID);
+    void loadCubemap(const std::vector<std::string> &faces, unsigned int *textureID);
+    void loadModel(const std::string &path, Model *model);
+
+    // uploads finished assets on the calling thread until every requested asset is on the GPU
+    void finish();
+    // CPU and upload time of every asset
+    void printReport() const;
+    // vertex and index memory of every model, vertex cache statistics (ACMR, ATVR) and index size of every mesh
+    void printMeshReport() const;
+
+private:
+    struct Upload {
+        std::string name;
+        double cpuSeconds;
+        std::function<void()> upload;
+    };
+
+    struct Timing {
+        std::string name;
+        double cpuSeconds;
+        double uploadSeconds;
+    };
+
+    void submit(std::function<void()> job);
+    void pushUpload(const std::string &name, double cpuSeconds, std::function<void()> upload);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    std::deque<Upload> uploads;
+    std::mutex uploadMutex;
+    std::condition_variable uploadAvailable;
+
+    // assets requested but not uploaded yet, only touched by the GL thread
+    unsigned int pending;
+    std::vector<Timing> timings;
+    // for the memory report
+    std::vector<std::pair<std::string, Model*>> models;
+    double startTime;
+    double wallSeconds;
+};
+
+
+#endif //ASSETLOADER_H
@@ -0,0 +1,479 @@
+#include "benchmark.h"
+
+#include <learnopengl/model.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/shader.h>
+
+#include <dirent.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <new>
+
+#include "programState.h"
+#include "character.h"
+#include "scene.h"
+#include "frameUniforms.h"
+#include "bloom.h"
+#include "renderer.h"
+
+// Heap allocations of the whole process for the load benchmark. The global operator new is replaced
+// because that is the only place that sees the allocations of the containers and of Assimp,
+// so it is only compiled into builds configured with -DBENCH_ALLOCATIONS=ON.
+namespace {
+std::atomic<unsigned long> allocationCount(0);
+std::atomic<unsigned long long> allocatedBytes(0);
+}
+
+#ifdef BENCH_ALLOCATIONS
+void *operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void *memory = std::malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+std::vector<std::string> Benchmark::findModels(const std::string &directory){
+    std::vector<std::string> models;
+
+    DIR *objects = opendir(directory.c_str());
+    if(objects == nullptr){
+        std::cout << "Benchmark: could not open " << directory << std::endl;
+        return models;
+    }
+
+    while(dirent *entry = readdir(objects)){
+        std::string name = entry->d_name;
+        if(name == "." || name == "..")
+            continue;
+
+        std::string subdirectory = directory + "/" + name;
+        DIR *modelDirectory = opendir(subdirectory.c_str());
+        if(modelDirectory == nullptr)
+            continue;
+
+        while(dirent *file = readdir(modelDirectory)){
+            std::string fileName = file->d_name;
+            std::string extension = fileName.substr(fileName.find_last_of('.') + 1);
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if(extension == "obj" || extension == "fbx")
+                models.push_back(subdirectory + "/" + fileName);
+        }
+        closedir(modelDirectory);
+    }
+    closedir(objects);
+
+    std::sort(models.begin(), models.end());
+    return models;
+}
+
+void Benchmark::meshCacheLoad(){
+    std::vector<std::string> models = findModels("resources/objects");
+
+    struct Load {
+        double seconds = 0.0;
+        unsigned long allocations = 0;
+        unsigned long long bytes = 0;
+    };
+    // import and upload of one model, the model is destroyed before the counters are read again
+    auto load = [](const std::string &path, bool &fromCache) {
+        Load result;
+        unsigned long allocations = allocationCount.load();
+        unsigned long long bytes = allocatedBytes.load();
+        {
+            Model model(path);
+            result.seconds = model.loadSeconds;
+            fromCache = model.loadedFromCache;
+        }
+        result.allocations = allocationCount.load() - allocations;
+        result.bytes = allocatedBytes.load() - bytes;
+        return result;
+    };
+
+    Load coldTotal, warmTotal;
+
+#ifndef BENCH_ALLOCATIONS
+    std::printf("heap allocations are not counted, configure with -DBENCH_ALLOCATIONS=ON to count them\n");
+#endif
+    std::printf("%-60s %10s %10s %10s %10s %10s %8s\n", "model", "cold [ms]", "allocs", "warm [ms]", "allocs",
+                "warm [MB]", "speedup");
+    for(const std::string &path : models){
+        MeshCache::invalidate(path);
+
+        bool fromCache = false;
+        Load cold = load(path, fromCache);
+        Load warm = load(path, fromCache);
+
+        coldTotal.seconds += cold.seconds;
+        coldTotal.allocations += cold.allocations;
+        warmTotal.seconds += warm.seconds;
+        warmTotal.allocations += warm.allocations;
+        warmTotal.bytes += warm.bytes;
+
+        std::printf("%-60s %10.2f %10lu %10.2f %10lu %10.2f %7.1fx%s\n", path.c_str(), cold.seconds * 1000.0, cold.allocations,
+                    warm.seconds * 1000.0, warm.allocations, warm.bytes / (1024.0 * 1024.0),
+                    cold.seconds / std::max(warm.seconds, 1e-9), fromCache ? "" : "  (cache miss)");
+    }
+    std::printf("%-60s %10.2f %10lu %10.2f %10lu %10.2f %7.1fx\n", "total", coldTotal.seconds * 1000.0, coldTotal.allocations,
+                warmTotal.seconds * 1000.0, warmTotal.allocations, warmTotal.bytes / (1024.0 * 1024.0),
+                coldTotal.seconds / std::max(warmTotal.seconds, 1e-9));
+}
+
+bool Benchmark::geometryArena(){
+    std::vector<std::string> paths = findModels("resources/objects");
+    // small buffers, so the first load also grows them
+    GeometryArena arena(true, GL_UNSIGNED_SHORT, 1 << 12, 1 << 14);
+    std::vector<Model> models(paths.size());
+
+    auto load = [&arena](Model &model, const std::string &path) {
+        model.packVertices = true;
+        model.optimizeMeshes = true;
+        model.shortIndices = true;
+        model.arena = &arena;
+        model.import(path);
+        model.upload();
+    };
+
+    // vertices, positions and indices of the meshes of a model in the arena, meshes with their own buffers are skipped
+    auto contents = [&arena](const Model &model) {
+        std::vector<unsigned char> bytes;
+        auto read = [&bytes](unsigned int buffer, const GeometryArena::Span &span, size_t stride) {
+            size_t size = bytes.size();
+            bytes.resize(size + span.size * stride);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, span.offset * stride, span.size * stride, bytes.data() + size);
+        };
+        for(const Mesh &mesh : model.meshes){
+            if(mesh.arena == nullptr)
+                continue;
+            const GeometryArena::Allocation &allocation = arena[mesh.allocation];
+            read(arena.vertices(), allocation.vertices, VertexStride(true));
+            read(arena.positions(), allocation.vertices, PositionStride(true));
+            read(arena.indices(), allocation.indices, IndexSize(arena.indexType()));
+        }
+        return bytes;
+    };
+
+    // samples the model covers drawn through the arena VAO and its current offsets, fitted into the viewport
+    Shader depthShader("resources/shaders/depth/depthShader.vs", "resources/shaders/depth/depthShader.fs",
+                       nullptr, "#define SINGLE_FACE\n");
+    unsigned int query;
+    glGenQueries(1, &query);
+    auto samples = [&depthShader, query](Model &model) {
+        GLState &state = GLState::get();
+        state.setEnabled(GL_DEPTH_TEST, false);
+        state.setEnabled(GL_CULL_FACE, false);
+        state.useProgram(depthShader.ID);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glm::vec3 padding = (model.bounds.max - model.bounds.min) * 0.05f + glm::vec3(0.01f);
+        glm::vec3 low = model.bounds.min - padding, high = model.bounds.max + padding;
+        depthShader.setMat4("shadowMatrix", glm::ortho(low.x, high.x, low.y, high.y, -high.z, -low.z));
+        depthShader.setMat4("model", glm::mat4(1.0f));
+        depthShader.setFloat("far_plane", 1.0f);
+        glBeginQuery(GL_SAMPLES_PASSED, query);
+        model.Draw(depthShader);
+        glEndQuery(GL_SAMPLES_PASSED);
+        unsigned int passed = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+        return passed;
+    };
+
+    std::vector<std::vector<unsigned char>> expectedContents(models.size());
+    std::vector<unsigned int> expectedSamples(models.size());
+    for(unsigned int i = 0; i < models.size(); i++){
+        load(models[i], paths[i]);
+        expectedContents[i] = contents(models[i]);
+        expectedSamples[i] = samples(models[i]);
+    }
+
+    unsigned int failures = 0;
+    auto check = [&](const char *step) {
+        unsigned int mismatches = 0;
+        for(unsigned int i = 0; i < models.size(); i++)
+            if(!models[i].meshes.empty() && (contents(models[i]) != expectedContents[i] || samples(models[i]) != expectedSamples[i])){
+                std::printf("  %s differs\n", paths[i].c_str());
+                mismatches++;
+            }
+        GeometryArena::Stats stats = arena.stats();
+        std::printf("%-10s %8u %10u %10u %8u %11.1f%% %11.1f%% %8s\n", step, stats.allocations, stats.vertexUsed, stats.indexUsed,
+                    stats.freeSpans, stats.vertexFragmentation * 100.0f, stats.indexFragmentation * 100.0f,
+                    mismatches == 0 ? "ok" : "MISMATCH");
+        failures += mismatches;
+    };
+
+    std::printf("%-10s %8s %10s %10s %8s %12s %12s %8s\n", "step", "meshes", "vertices", "indices", "holes",
+                "vertex frag", "index frag", "contents");
+    check("load");
+    for(unsigned int i = 1; i < models.size(); i += 2)
+        models[i].release();
+    check("unload");
+    arena.compact();
+    check("compact");
+    if(arena.stats().freeSpans != 0)
+        failures++;
+    for(unsigned int i = 1; i < models.size(); i += 2)
+        load(models[i], paths[i]);
+    check("reload");
+    for(Model &model : models)
+        model.release();
+    // every hole merged back into the top of the buffers
+    GeometryArena::Stats stats = arena.stats();
+    std::printf("unloading everything leaves %u vertices, %u indices and %u holes in use, %u grows, %u compactions\n",
+                stats.vertexUsed, stats.indexUsed, stats.freeSpans, stats.grows, stats.compactions);
+    if(stats.vertexUsed != 0 || stats.indexUsed != 0 || stats.freeSpans != 0)
+        failures++;
+
+    glDeleteQueries(1, &query);
+    GLState::get().invalidate();
+    std::printf("geometry arena: %s\n", failures == 0 ? "all checks passed" : "FAILED");
+    return failures == 0;
+}
+
+void Benchmark::uniformUpload(unsigned int frames){
+    Shader ourShader("resources/shaders/model/model_shader.vs", "resources/shaders/model/model_shader.fs");
+    Shader brickBoxShader("resources/shaders/basic/shader.vs", "resources/shaders/basic/shader.fs");
+    Shader marioBoxShader("resources/shaders/basic/shader.vs", "resources/shaders/basic/shader.fs");
+    Shader coinShader("resources/shaders/coin/coinInstancingShader.vs", "resources/shaders/coin/coinInstancingShader.fs");
+    Model islandModel("resources/objects/island/EO0AAAMXQ0YGMC13XX7X56I3L.obj");
+    islandModel.SetShaderTextureNamePrefix("material.");
+
+    ProgramState programState;
+    Scene scene;
+    glm::mat4 projection = glm::perspective(glm::radians(programState.camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = programState.camera.GetViewMatrix();
+
+    FrameUniforms frameUniforms;
+    frameUniforms.init();
+    for(Shader *shader : {&ourShader, &brickBoxShader, &marioBoxShader, &coinShader})
+        frameUniforms.attach(*shader);
+    ourShader.use();
+    ourShader.setFloat("material.shininess", 32.0f);
+    coinShader.use();
+    scene.coinSetLights(coinShader);
+
+    // the draws themselves are not what is measured, keep the GPU idle
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    std::printf("%-10s %18s %18s %12s\n", "locations", "queries / frame", "uniforms / frame", "us / frame");
+    for(bool cached : {false, true}){
+        Shader::locationCacheEnabled() = cached;
+        Shader::counters() = Shader::CallCounters();
+
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned int frame = 0; frame < frames; frame++){
+            frameUniforms.setCamera(projection, view, programState.camera.Position);
+            scene.updateLights(frameUniforms, &programState);
+            frameUniforms.upload();
+
+            ourShader.use();
+            ourShader.setMat4("model", glm::mat4(1.0f));
+            islandModel.Draw(ourShader);
+
+            coinShader.use();
+            brickBoxShader.use();
+            marioBoxShader.use();
+        }
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-10s %18.1f %18.1f %12.2f\n", cached ? "cached" : "queried",
+                    (double)Shader::counters().locationQueries / frames,
+                    (double)Shader::counters().uniformCalls / frames, seconds * 1e6 / frames);
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    Shader::locationCacheEnabled() = true;
+}
+
+void Benchmark::bloomModes(unsigned int frames){
+    struct Resolution {
+        const char *name;
+        unsigned int width;
+        unsigned int height;
+    };
+    const Resolution resolutions[] = {{"800x600", 800, 600}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+    const unsigned int warmupFrames = 10;
+
+    Renderer renderer;
+    std::vector<unsigned int> queries(frames);
+    glGenQueries(frames, queries.data());
+
+    std::printf("%-10s %16s %16s %10s\n", "resolution", "ping-pong ms", "mip chain ms", "speedup");
+    for(const Resolution &resolution : resolutions){
+        // bright pass stand-in, the blur cost doesn't depend on what the texture holds
+        unsigned int source, sourceFBO;
+        glGenTextures(1, &source);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, resolution.width, resolution.height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenFramebuffers(1, &sourceFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, sourceFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+        glClearColor(2.0f, 1.5f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        Bloom bloom(resolution.width, resolution.height);
+        glViewport(0, 0, resolution.width, resolution.height);
+
+        double milliseconds[2];
+        for(Bloom::Mode mode : {Bloom::PING_PONG, Bloom::MIP_CHAIN}){
+            bloom.mode = mode;
+            for(unsigned int frame = 0; frame < warmupFrames; frame++)
+                bloom.render(source, renderer);
+            for(unsigned int frame = 0; frame < frames; frame++){
+                glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+                bloom.render(source, renderer);
+                glEndQuery(GL_TIME_ELAPSED);
+            }
+            GLuint64 total = 0;
+            for(unsigned int frame = 0; frame < frames; frame++){
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[frame], GL_QUERY_RESULT, &nanoseconds);
+                total += nanoseconds;
+            }
+            milliseconds[mode] = (double)total / frames / 1e6;
+        }
+        std::printf("%-10s %16.3f %16.3f %9.2fx\n", resolution.name, milliseconds[Bloom::PING_PONG],
+                    milliseconds[Bloom::MIP_CHAIN], milliseconds[Bloom::PING_PONG] / milliseconds[Bloom::MIP_CHAIN]);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &sourceFBO);
+        glDeleteTextures(1, &source);
+        GLState::get().invalidate();
+    }
+    glDeleteQueries(frames, queries.data());
+}
+
+void Benchmark::scriptedPath(float progress, ProgramState &programState, Character &character, Scene &scene){
+    //  progress  camera position                         camera target                        character position                 angle   inside
+    static const Waypoint path[] = {
+        {0.00f, glm::vec3(-14.63f, 0.28f, -7.27f), glm::vec3(-5.83f, -0.02f, -2.57f), glm::vec3(-5.0f, -3.0f, 0.2f),    180.0f, false},
+        {0.25f, glm::vec3(-8.0f, 3.0f, 8.0f),      glm::vec3(-18.0f, 0.0f, 0.0f),     glm::vec3(-10.0f, -3.5f, 2.0f),   270.0f, false},
+        {0.45f, glm::vec3(-26.0f, 4.0f, 10.0f),    glm::vec3(-18.0f, 0.0f, 0.0f),     glm::vec3(-19.0f, -4.0f, 4.0f),   270.0f, false},
+        {0.60f, glm::vec3(6.0f, 6.0f, 12.0f),      glm::vec3(0.0f, -2.0f, 0.0f),      glm::vec3(-3.57f, -3.0f, -7.71f), 0.0f,   false},
+        {0.61f, glm::vec3(29.67f, -0.11f, -5.66f), glm::vec3(20.57f, -1.91f, -2.16f), glm::vec3(14.3f, -4.5f, -4.77f),  90.0f,  true},
+        {1.00f, glm::vec3(24.0f, 1.0f, 6.0f),      glm::vec3(18.0f, -4.0f, 0.0f),     glm::vec3(17.0f, -4.5f, -2.0f),   45.0f,  true},
+    };
+    const unsigned int count = sizeof(path) / sizeof(path[0]);
+
+    progress = glm::clamp(progress, 0.0f, 1.0f);
+    unsigned int segment = 0;
+    while(segment + 2 < count && progress >= path[segment + 1].progress)
+        segment++;
+
+    const Waypoint &from = path[segment];
+    const Waypoint &to = path[segment + 1];
+    // teleporting in or out of the hidden room is a cut, not a fly-through
+    float t = from.inside == to.inside ? (progress - from.progress) / (to.progress - from.progress) : 0.0f;
+    t = glm::clamp(t, 0.0f, 1.0f);
+
+    programState.camera.Position = glm::mix(from.cameraPosition, to.cameraPosition, t);
+    programState.camera.Front = glm::normalize(glm::mix(from.cameraTarget, to.cameraTarget, t) - programState.camera.Position);
+    character.currentCharacter = Character::mario;
+    character.teleport(glm::mix(from.characterPosition, to.characterPosition, t));
+    character.characterAngle = glm::mix(from.characterAngle, to.characterAngle, t);
+    scene.inside = from.inside;
+}
+
+bool Benchmark::writeFrameReport(const std::deque<Profiler::FrameTiming> &frames, unsigned int warmupFrames,
+                                 float timestep, unsigned int width, unsigned int height, const std::string &path){
+    FILE *out = std::fopen(path.c_str(), "w");
+    if(out == nullptr){
+        std::cout << "Benchmark: could not write " << path << std::endl;
+        return false;
+    }
+
+    // samples per pass, passes in the order they first show up
+    std::vector<std::string> passNames;
+    std::map<std::string, std::vector<double>> cpuSamples, gpuSamples;
+    std::map<std::string, bool> gpuTimed;
+    std::vector<double> frameCpu, frameGpu, stateCalls, stateCallsSkipped;
+    for(const Profiler::FrameTiming &frame : frames){
+        if(frame.index < warmupFrames)
+            continue;
+        frameCpu.push_back(frame.cpuMs);
+        frameGpu.push_back(frame.gpuMs);
+        stateCalls.push_back((double)frame.stateCalls);
+        stateCallsSkipped.push_back((double)frame.stateCallsSkipped);
+        for(const Profiler::PassTiming &pass : frame.passes){
+            if(cpuSamples.find(pass.name) == cpuSamples.end())
+                passNames.push_back(pass.name);
+            cpuSamples[pass.name].push_back(pass.cpuMs);
+            if(pass.gpu)
+                gpuSamples[pass.name].push_back(pass.gpuMs);
+            gpuTimed[pass.name] = gpuTimed[pass.name] || pass.gpu;
+        }
+    }
+
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+    std::replace(renderer.begin(), renderer.end(), '"', '\'');
+
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"renderer\": \"%s\",\n", renderer.c_str());
+    std::fprintf(out, "  \"width\": %u,\n  \"height\": %u,\n", width, height);
+    std::fprintf(out, "  \"timestep\": %.6f,\n", timestep);
+    std::fprintf(out, "  \"frames\": %u,\n  \"warmupFrames\": %u,\n", (unsigned int)frameCpu.size(), warmupFrames);
+    std::fprintf(out, "  \"frame\": {\n");
+    writeStatistics(out, "cpuMs", frameCpu);
+    std::fprintf(out, ",\n");
+    writeStatistics(out, "gpuMs", frameGpu);
+    std::fprintf(out, ",\n");
+    writeStatistics(out, "stateCalls", stateCalls);
+    std::fprintf(out, ",\n");
+    writeStatistics(out, "stateCallsSkipped", stateCallsSkipped);
+    std::fprintf(out, "\n  },\n");
+    std::fprintf(out, "  \"passes\": [\n");
+    for(unsigned int i = 0; i < passNames.size(); i++){
+        std::fprintf(out, "    {\n      \"name\": \"%s\",\n      \"samples\": %u,\n", passNames[i].c_str(),
+                     (unsigned int)cpuSamples[passNames[i]].size());
+        writeStatistics(out, "cpuMs", cpuSamples[passNames[i]]);
+        // passes nested inside another GPU timed pass only have CPU times
+        if(gpuTimed[passNames[i]]){
+            std::fprintf(out, ",\n");
+            writeStatistics(out, "gpuMs", gpuSamples[passNames[i]]);
+        }
+        std::fprintf(out, "\n    }%s\n", i + 1 < passNames.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    std::fclose(out);
+    return true;
+}
+
+void Benchmark::writeStatistics(FILE *out, const char *name, std::vector<double> samples){
+    std::sort(samples.begin(), samples.end());
+    // nearest rank percentile
+    auto percentile = [&samples](double p){
+        if(samples.empty())
+            return 0.0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * samples.size());
+        return samples[std::min(std::max(rank, (size_t)1), samples.size()) - 1];
+    };
+    double sum = 0.0;
+    for(double sample : samples)
+        sum += sample;
+
+    std::fprintf(out, "      \"%s\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+                      "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+                 name, samples.empty() ? 0.0 : sum / samples.size(), samples.empty() ? 0.0 : samples.front(),
+                 percentile(50.0), percentile(90.0), percentile(95.0), percentile(99.0),
+                 samples.empty() ? 0.0 : samples.back());
+}
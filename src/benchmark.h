@@ -0,0 +1,61 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "profiler.h"
+
+struct ProgramState;
+class Character;
+class Scene;
+
+class Benchmark {
+public:
+    // Loads every model in resources/objects once with an empty mesh cache (cold)
+    // and once more from the cache it just wrote (warm), and prints the times of both.
+    // Builds with BENCH_ALLOCATIONS also print the heap allocations of both.
+    static void meshCacheLoad();
+
+    // Loads every model in resources/objects into a small geometry arena, then unloads every other model, compacts the arena
+    // and reloads the unloaded ones. After each step the bytes of every mesh are read back from the arena buffers and every
+    // model is drawn once with a samples passed query, both have to match the first load. Returns false on a mismatch.
+    static bool geometryArena();
+
+    // Replays the per-frame uniform traffic of the island pass (camera and light block upload,
+    // shader switches, island draw) with and without the uniform location cache and prints
+    // driver calls per frame and CPU time for both.
+    static void uniformUpload(unsigned int frames = 1000);
+
+    // GPU time of the ping-pong Gaussian and the mip chain bloom blur at 800x600, 1080p and 4K,
+    // measured with timer queries on offscreen targets
+    static void bloomModes(unsigned int frames = 100);
+
+    // Scripted camera and character path of the headless render benchmark (--bench).
+    // progress goes from 0 to 1 over the run: island, ship, back over the island and into the hidden room.
+    static void scriptedPath(float progress, ProgramState &programState, Character &character, Scene &scene);
+
+    // Writes per-pass CPU/GPU timings of a --bench run as JSON (mean, min, percentiles, max),
+    // the first warmupFrames frames are left out.
+    static bool writeFrameReport(const std::deque<Profiler::FrameTiming> &frames, unsigned int warmupFrames,
+                                 float timestep, unsigned int width, unsigned int height, const std::string &path);
+
+private:
+    struct Waypoint {
+        float progress;
+        glm::vec3 cameraPosition;
+        glm::vec3 cameraTarget;
+        glm::vec3 characterPosition;
+        float characterAngle;
+        bool inside;
+    };
+
+    static std::vector<std::string> findModels(const std::string &directory);
+    static void writeStatistics(FILE *out, const char *name, std::vector<double> samples);
+};
+
+
+#endif //BENCHMARK_H
@@ -0,0 +1,179 @@
+#include "bloom.h"
+#include "renderer.h"
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <iostream>
+
+Bloom::Bloom(unsigned int width, unsigned int height)
+    : downsampleShader("resources/shaders/bloom/bloom.vs", "resources/shaders/bloom/downsample.fs"),
+      upsampleShader("resources/shaders/bloom/bloom.vs", "resources/shaders/bloom/upsample.fs")
+{
+    this->width = width;
+    this->height = height;
+    mode = PING_PONG;
+    pingPongPasses = 10;
+    mipCount = 6;
+    filterRadius = 1.0f;
+    upsampleBlend = 0.7f;
+
+    downsampleShader.use();
+    downsampleShader.setInt("srcTexture", 0);
+    upsampleShader.use();
+    upsampleShader.setInt("srcTexture", 0);
+
+    allocate();
+}
+
+Bloom::~Bloom()
+{
+    release();
+}
+
+void Bloom::resize(unsigned int width, unsigned int height)
+{
+    if (width == this->width && height == this->height)
+        return;
+    release();
+    this->width = width;
+    this->height = height;
+    allocate();
+}
+
+void Bloom::allocate()
+{
+    // Ping-pong-framebuffer for blurring
+    glGenFramebuffers(2, pingpongFBO);
+    glGenTextures(2, pingpongColorbuffers);
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
+        // also check if framebuffers are complete (no need for depth buffer)
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete!" << std::endl;
+    }
+
+    // Mip chain, every level half the size of the previous one starting at half resolution.
+    // R11F_G11F_B10F is half the bandwidth of RGBA16F and bloom has no use for alpha.
+    unsigned int mipWidth = width, mipHeight = height;
+    for (unsigned int i = 0; i < MAX_MIPS && mipWidth > 1 && mipHeight > 1; i++)
+    {
+        mipWidth = std::max(1u, mipWidth / 2);
+        mipHeight = std::max(1u, mipHeight / 2);
+
+        Mip mip;
+        mip.width = mipWidth;
+        mip.height = mipHeight;
+        glGenTextures(1, &mip.texture);
+        glBindTexture(GL_TEXTURE_2D, mip.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, mipWidth, mipHeight, 0, GL_RGB, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(1, &mip.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, mip.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mip.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer not complete!" << std::endl;
+        mips.push_back(mip);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the bindings above went around the state cache
+    GLState::get().invalidate();
+}
+
+void Bloom::release()
+{
+    glDeleteFramebuffers(2, pingpongFBO);
+    glDeleteTextures(2, pingpongColorbuffers);
+    for (Mip &mip : mips)
+    {
+        glDeleteFramebuffers(1, &mip.framebuffer);
+        glDeleteTextures(1, &mip.texture);
+    }
+    mips.clear();
+}
+
+unsigned int Bloom::render(unsigned int brightTexture, Renderer &renderer)
+{
+    if (mode == MIP_CHAIN && !mips.empty())
+        return renderMipChain(brightTexture, renderer);
+    return renderPingPong(brightTexture, renderer);
+}
+
+unsigned int Bloom::renderPingPong(unsigned int brightTexture, Renderer &renderer)
+{
+    GLState &state = GLState::get();
+    bool horizontal = true, first_iteration = true;
+    for (unsigned int i = 0; i < pingPongPasses; i++)
+    {
+        state.bindFramebuffer(pingpongFBO[horizontal]);
+        blur.use(horizontal);
+        state.bindTexture(0, GL_TEXTURE_2D, first_iteration ? brightTexture : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+        renderer.renderQuad();
+        horizontal = !horizontal;
+        if (first_iteration)
+            first_iteration = false;
+    }
+    return first_iteration ? brightTexture : pingpongColorbuffers[!horizontal];
+}
+
+unsigned int Bloom::renderMipChain(unsigned int brightTexture, Renderer &renderer)
+{
+    GLState &state = GLState::get();
+    unsigned int levels = std::max(1u, std::min(mipCount, (unsigned int)mips.size()));
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    state.setEnabled(GL_BLEND, false);
+
+    // Downsample, level i reads level i-1 (the bright texture for the first one)
+    downsampleShader.use();
+    unsigned int source = brightTexture;
+    unsigned int sourceWidth = width, sourceHeight = height;
+    for (unsigned int i = 0; i < levels; i++)
+    {
+        const Mip &mip = mips[i];
+        state.bindFramebuffer(mip.framebuffer);
+        glViewport(0, 0, mip.width, mip.height);
+        downsampleShader.setVec2("srcTexelSize", 1.0f / sourceWidth, 1.0f / sourceHeight);
+        // Karis average on the first level keeps single very bright pixels from flickering
+        downsampleShader.setBool("karisAverage", i == 0);
+        state.bindTexture(0, GL_TEXTURE_2D, source);
+        renderer.renderQuad();
+
+        source = mip.texture;
+        sourceWidth = mip.width;
+        sourceHeight = mip.height;
+    }
+
+    // Upsample back to the first level, dst = mix(dst, upsampled, upsampleBlend) by the blend unit
+    upsampleShader.use();
+    state.setEnabled(GL_BLEND, true);
+    state.blendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    glBlendColor(0.0f, 0.0f, 0.0f, upsampleBlend);
+    for (unsigned int i = levels - 1; i > 0; i--)
+    {
+        const Mip &smaller = mips[i];
+        const Mip &mip = mips[i - 1];
+        state.bindFramebuffer(mip.framebuffer);
+        glViewport(0, 0, mip.width, mip.height);
+        upsampleShader.setVec2("filterRadius", filterRadius / smaller.width, filterRadius / smaller.height);
+        state.bindTexture(0, GL_TEXTURE_2D, smaller.texture);
+        renderer.renderQuad();
+    }
+    state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    return mips[0].texture;
+}
@@ -0,0 +1,73 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <learnopengl/shader.h>
+
+#include "gaussianBlur.h"
+
+#include <vector>
+
+class Renderer;
+
+// Blurs the bright fragments of the scene for the bloom composite (bloomShader).
+// PING_PONG runs the separable GaussianBlur back and forth between two full resolution targets.
+// MIP_CHAIN downsamples into a chain of half resolution mips with a 13-tap filter and then walks back up
+// with a 3x3 tent filter, blending every level into the next larger one. Its cost is dominated by the
+// first half resolution mip instead of passes * full resolution.
+class Bloom {
+public:
+    enum Mode {
+        PING_PONG = 0,
+        MIP_CHAIN = 1
+    };
+
+    static const unsigned int MAX_MIPS = 8;
+
+    Bloom(unsigned int width, unsigned int height);
+    ~Bloom();
+    Bloom(const Bloom&) = delete;
+    Bloom& operator=(const Bloom&) = delete;
+
+    // reallocates the targets for a new resolution of the bright texture, does nothing if it didn't change
+    void resize(unsigned int width, unsigned int height);
+
+    // blurs brightTexture and returns the texture to composite, valid until the next render call
+    unsigned int render(unsigned int brightTexture, Renderer &renderer);
+
+    Mode mode;
+    // blur passes of PING_PONG (half horizontal, half vertical), the kernel is set on blur
+    unsigned int pingPongPasses;
+    GaussianBlur blur;
+    // mips used by MIP_CHAIN, clamped to the mips the resolution allows
+    unsigned int mipCount;
+    // radius of the tent filter in texels of the smaller mip
+    float filterRadius;
+    // how much of the upsampled smaller mip replaces a level, 1 keeps only the coarsest level
+    float upsampleBlend;
+
+private:
+    struct Mip {
+        unsigned int width;
+        unsigned int height;
+        unsigned int texture;
+        unsigned int framebuffer;
+    };
+
+    void allocate();
+    void release();
+    unsigned int renderPingPong(unsigned int brightTexture, Renderer &renderer);
+    unsigned int renderMipChain(unsigned int brightTexture, Renderer &renderer);
+
+    unsigned int width;
+    unsigned int height;
+
+    Shader downsampleShader;
+    Shader upsampleShader;
+
+    unsigned int pingpongFBO[2];
+    unsigned int pingpongColorbuffers[2];
+    std::vector<Mip> mips;
+};
+
+
+#endif //BLOOM_H
@@ -4,6 +4,8 @@
 
 #include "character.h"
 
+#include <glm/glm.hpp>
+
 #include "scene.h"
 
 Character::Character()
@@ -30,6 +32,9 @@ Character::Character()
     // Character movement
     characterAngle = 180.0f;
     characterSpeed = 0.07f;
+
+    previousPosition = characterPosition;
+    previousAngle = characterAngle;
 }
 
 void Character::marioColorCheck(){
@@ -81,7 +86,7 @@ void Character::fallCheck()
         if(characterPosition.y <= -20.0f){
             falling = false;
             rise = true;
-            characterPosition = glm::vec3(-5.0f, -5.0f, 0.2f);
+            teleport(glm::vec3(-5.0f, -5.0f, 0.2f));
         }
         else
             characterPosition.y -= 0.2f;
@@ -97,4 +102,28 @@ void Character::fallCheck()
 bool Character::isOnPoint(float x, float z, float delta){
     return(characterPosition.x > x-delta && characterPosition.x < x+delta
            && characterPosition.z > z-delta && characterPosition.z < z + delta);
-}
\ No newline at end of file
+}
+void Character::beginTick(){
+    previousPosition = characterPosition;
+    previousAngle = characterAngle;
+}
+
+// Moves without interpolating from the old position, otherwise the character would be drawn flying through the level
+void Character::teleport(glm::vec3 position){
+    characterPosition = position;
+    previousPosition = position;
+}
+
+glm::vec3 Character::interpolatedPosition(float alpha) const{
+    return glm::mix(previousPosition, characterPosition, alpha);
+}
+
+float Character::interpolatedAngle(float alpha) const{
+    // the angle wraps at +-360, interpolate over the short way
+    float delta = characterAngle - previousAngle;
+    if(delta > 180.0f)
+        delta -= 360.0f;
+    else if(delta < -180.0f)
+        delta += 360.0f;
+    return previousAngle + delta * alpha;
+}
@@ -44,6 +44,14 @@ public:
     bool isOnPoint(float x, float z, float delta);
     float characterAngle;
     float characterSpeed;
+
+    // saves the position and angle before the tick moves them
+    void beginTick();
+    void teleport(glm::vec3 position);
+    glm::vec3 interpolatedPosition(float alpha) const;
+    float interpolatedAngle(float alpha) const;
+    glm::vec3 previousPosition{};
+    float previousAngle;
 };
 
 
@@ -0,0 +1,299 @@
+#include "clusteredLights.h"
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+static_assert(sizeof(ClusteredLights::Light) == 64, "Light does not match the 4 texel layout of the shaders");
+static_assert(ClusteredLights::TILES_X % 4 == 0, "rows are tested four clusters at a time");
+
+ClusteredLights::ClusteredLights()
+{
+    simd = true;
+    lightBuffer = gridBuffer = indexBuffer = 0;
+    lightTexture = gridTexture = indexTexture = 0;
+    boundsProjection = glm::mat4(0.0f);
+    nearPlane = farPlane = 0.0f;
+    sliceScale = sliceBias = 0.0f;
+
+    minX.resize(CLUSTER_COUNT);
+    minY.resize(CLUSTER_COUNT);
+    minZ.resize(CLUSTER_COUNT);
+    maxX.resize(CLUSTER_COUNT);
+    maxY.resize(CLUSTER_COUNT);
+    maxZ.resize(CLUSTER_COUNT);
+    rowMin.resize(SLICES * TILES_Y * 3);
+    rowMax.resize(SLICES * TILES_Y * 3);
+    grid.resize(CLUSTER_COUNT * 2);
+}
+
+ClusteredLights::~ClusteredLights()
+{
+    if (lightBuffer == 0)
+        return;
+    glDeleteTextures(1, &lightTexture);
+    glDeleteTextures(1, &gridTexture);
+    glDeleteTextures(1, &indexTexture);
+    glDeleteBuffers(1, &lightBuffer);
+    glDeleteBuffers(1, &gridBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+void ClusteredLights::init()
+{
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glGenTextures(1, &lightTexture);
+    glGenTextures(1, &gridTexture);
+    glGenTextures(1, &indexTexture);
+
+    // buffer textures need a data store to be attached to, the buffers are resized by every update
+    const unsigned int buffers[3] = {lightBuffer, gridBuffer, indexBuffer};
+    const unsigned int textures[3] = {lightTexture, gridTexture, indexTexture};
+    const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    // the texture bindings above went around the state cache
+    GLState::get().invalidate();
+}
+
+void ClusteredLights::attach(Shader &shader)
+{
+    shader.use();
+    shader.setInt("clusterLights", LIGHTS_UNIT);
+    shader.setInt("clusterGrid", GRID_UNIT);
+    shader.setInt("clusterIndices", INDEX_UNIT);
+}
+
+void ClusteredLights::clear()
+{
+    lights.clear();
+}
+
+void ClusteredLights::add(const glm::vec3 &position, const glm::vec3 &ambient, const glm::vec3 &diffuse,
+                          const glm::vec3 &specular, float constant, float linear, float quadratic)
+{
+    if (lights.size() >= MAX_LIGHTS)
+        return;
+
+    // solve constant + linear * d + quadratic * d^2 = 256 * brightest channel for d
+    float brightest = std::max(std::max(diffuse.r, diffuse.g), std::max(diffuse.b, std::max(specular.r, std::max(specular.g, specular.b))));
+    float threshold = 256.0f * std::max(brightest, 1e-3f);
+    float radius;
+    if (quadratic > 0.0f)
+        radius = (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - threshold))) / (2.0f * quadratic);
+    else if (linear > 0.0f)
+        radius = (threshold - constant) / linear;
+    else
+        radius = 1e4f;
+
+    Light light;
+    light.position = position;
+    light.constant = constant;
+    light.ambient = ambient;
+    light.linear = linear;
+    light.diffuse = diffuse;
+    light.quadratic = quadratic;
+    light.specular = specular;
+    light.radius = std::max(radius, 0.0f);
+    lights.push_back(light);
+}
+
+int ClusteredLights::sliceOf(float depth) const
+{
+    int slice = (int)std::floor(std::log(depth) * sliceScale - sliceBias);
+    return std::max(0, std::min(slice, (int)SLICES - 1));
+}
+
+void ClusteredLights::buildClusterBounds(const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+    this->nearPlane = nearPlane;
+    this->farPlane = farPlane;
+    boundsProjection = projection;
+    // slice = log(depth) * sliceScale - sliceBias, the same mapping as in the shaders
+    sliceScale = SLICES / std::log(farPlane / nearPlane);
+    sliceBias = SLICES * std::log(nearPlane) / std::log(farPlane / nearPlane);
+
+    // a point at NDC x and view depth d lies at view x = x * d / projection[0][0] (symmetric frustum)
+    float scaleX = 1.0f / projection[0][0];
+    float scaleY = 1.0f / projection[1][1];
+    for (unsigned int slice = 0; slice < SLICES; slice++)
+    {
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)slice / SLICES);
+        float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(slice + 1) / SLICES);
+        for (unsigned int y = 0; y < TILES_Y; y++)
+        {
+            float y0 = -1.0f + 2.0f * y / TILES_Y, y1 = -1.0f + 2.0f * (y + 1) / TILES_Y;
+            unsigned int row = slice * TILES_Y + y;
+            for (unsigned int x = 0; x < TILES_X; x++)
+            {
+                float x0 = -1.0f + 2.0f * x / TILES_X, x1 = -1.0f + 2.0f * (x + 1) / TILES_X;
+                unsigned int cluster = row * TILES_X + x;
+                minX[cluster] = std::min(x0 * sliceNear, x0 * sliceFar) * scaleX;
+                maxX[cluster] = std::max(x1 * sliceNear, x1 * sliceFar) * scaleX;
+                minY[cluster] = std::min(y0 * sliceNear, y0 * sliceFar) * scaleY;
+                maxY[cluster] = std::max(y1 * sliceNear, y1 * sliceFar) * scaleY;
+                minZ[cluster] = sliceNear;
+                maxZ[cluster] = sliceFar;
+            }
+            unsigned int first = row * TILES_X, last = first + TILES_X - 1;
+            rowMin[row * 3] = minX[first];
+            rowMax[row * 3] = maxX[last];
+            rowMin[row * 3 + 1] = minY[first];
+            rowMax[row * 3 + 1] = maxY[first];
+            rowMin[row * 3 + 2] = sliceNear;
+            rowMax[row * 3 + 2] = sliceFar;
+        }
+    }
+}
+
+unsigned int ClusteredLights::testOne(unsigned int cluster, const glm::vec3 &center, float radius) const
+{
+    // squared distance from the sphere center to the box
+    float dx = std::max(0.0f, std::max(minX[cluster] - center.x, center.x - maxX[cluster]));
+    float dy = std::max(0.0f, std::max(minY[cluster] - center.y, center.y - maxY[cluster]));
+    float dz = std::max(0.0f, std::max(minZ[cluster] - center.z, center.z - maxZ[cluster]));
+    return dx * dx + dy * dy + dz * dz <= radius * radius ? 1u : 0u;
+}
+
+unsigned int ClusteredLights::testFour(unsigned int first, const glm::vec3 &center, float radius) const
+{
+#ifdef CLUSTERS_SSE
+    const __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+    __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[first]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&maxX[first]))));
+    __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[first]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&maxY[first]))));
+    __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[first]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[first]))));
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(distance, _mm_set1_ps(radius * radius)));
+#else
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < 4; i++)
+        mask |= testOne(first + i, center, radius) << i;
+    return mask;
+#endif
+}
+
+void ClusteredLights::bin(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (projection != boundsProjection || nearPlane != this->nearPlane || farPlane != this->farPlane)
+        buildClusterBounds(projection, nearPlane, farPlane);
+
+    std::fill(grid.begin(), grid.end(), 0u);
+    pairs.clear();
+
+    for (unsigned int light = 0; light < lights.size(); light++)
+    {
+        glm::vec4 viewPosition = view * glm::vec4(lights[light].position, 1.0f);
+        // the boxes use positive depth along the view direction
+        glm::vec3 center(viewPosition.x, viewPosition.y, -viewPosition.z);
+        float radius = lights[light].radius;
+        if (center.z + radius < nearPlane || center.z - radius > farPlane)
+            continue;
+
+        int firstSlice = sliceOf(std::max(center.z - radius, nearPlane));
+        int lastSlice = sliceOf(std::min(center.z + radius, farPlane));
+        for (int slice = firstSlice; slice <= lastSlice; slice++)
+        {
+            for (unsigned int y = 0; y < TILES_Y; y++)
+            {
+                unsigned int row = slice * TILES_Y + y;
+                const float *low = &rowMin[row * 3], *high = &rowMax[row * 3];
+                float dx = std::max(0.0f, std::max(low[0] - center.x, center.x - high[0]));
+                float dy = std::max(0.0f, std::max(low[1] - center.y, center.y - high[1]));
+                float dz = std::max(0.0f, std::max(low[2] - center.z, center.z - high[2]));
+                if (dx * dx + dy * dy + dz * dz > radius * radius)
+                    continue;
+
+                for (unsigned int x = 0; x < TILES_X; x += 4)
+                {
+                    unsigned int first = row * TILES_X + x;
+                    unsigned int mask;
+                    if (simd)
+                        mask = testFour(first, center, radius);
+                    else
+                        mask = testOne(first, center, radius) | testOne(first + 1, center, radius) << 1 |
+                               testOne(first + 2, center, radius) << 2 | testOne(first + 3, center, radius) << 3;
+                    for (unsigned int i = 0; mask != 0; i++, mask >>= 1)
+                    {
+                        if (!(mask & 1u))
+                            continue;
+                        grid[(first + i) * 2 + 1]++;
+                        pairs.push_back((first + i) << 16 | light);
+                    }
+                }
+            }
+        }
+    }
+
+    // offsets from the counts, then the index list in cluster order. Lights keep their order inside a cluster.
+    stats = Stats();
+    unsigned int offset = 0;
+    for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+    {
+        unsigned int count = grid[cluster * 2 + 1];
+        grid[cluster * 2] = offset;
+        offset += count;
+        stats.occupiedClusters += count > 0 ? 1 : 0;
+        stats.maxPerCluster = std::max(stats.maxPerCluster, count);
+        // reused as the fill position below
+        grid[cluster * 2 + 1] = 0;
+    }
+    indices.resize(pairs.size());
+    for (uint32_t pair : pairs)
+    {
+        unsigned int cluster = pair >> 16;
+        indices[grid[cluster * 2] + grid[cluster * 2 + 1]++] = (uint16_t)(pair & 0xFFFFu);
+    }
+
+    stats.lights = lights.size();
+    stats.indices = indices.size();
+    stats.binMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ClusteredLights::update(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane)
+{
+    bin(projection, view, nearPlane, farPlane);
+
+    // orphan and refill, the buffers of the previous frame may still be read by the GPU
+    auto upload = [](unsigned int buffer, const void *data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), nullptr, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    };
+    upload(lightBuffer, lights.data(), lights.size() * sizeof(Light));
+    upload(gridBuffer, grid.data(), grid.size() * sizeof(uint32_t));
+    upload(indexBuffer, indices.data(), indices.size() * sizeof(uint16_t));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::bind(Shader &shader, unsigned int width, unsigned int height)
+{
+    GLState &state = GLState::get();
+    state.bindTexture(LIGHTS_UNIT, GL_TEXTURE_BUFFER, lightTexture);
+    state.bindTexture(GRID_UNIT, GL_TEXTURE_BUFFER, gridTexture);
+    state.bindTexture(INDEX_UNIT, GL_TEXTURE_BUFFER, indexTexture);
+
+    shader.use();
+    shader.setVec2("clusterTileSize", (float)width / TILES_X, (float)height / TILES_Y);
+    shader.setFloat("clusterScale", sliceScale);
+    shader.setFloat("clusterBias", sliceBias);
+}
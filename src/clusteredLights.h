@@ -0,0 +1,103 @@
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+
+#include <cstdint>
+#include <vector>
+
+// Clustered forward shading of point lights.
+// The view frustum is split into TILES_X * TILES_Y screen tiles and SLICES depth slices, exponential in the
+// view depth. Every frame the lights are binned on the CPU: the view space sphere of a light is tested against
+// the bounding boxes of the clusters in its depth range, four clusters at a time with SSE. The lit shaders
+// find their cluster from gl_FragCoord and the view depth and only loop over the lights listed for it.
+// Lights, the (offset, count) grid and the light index list are buffer textures, GL 3.3 has no SSBOs.
+class ClusteredLights {
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // the index list is 16 bit
+    static const unsigned int MAX_LIGHTS = 4096;
+    // units of the buffer textures, above PointShadows::TEXTURE_UNIT
+    static const unsigned int LIGHTS_UNIT = 5;
+    static const unsigned int GRID_UNIT = 6;
+    static const unsigned int INDEX_UNIT = 7;
+
+    // 4 RGBA32F texels in the light buffer, laid out like PointLight in the shaders
+    struct Light {
+        glm::vec3 position;
+        float constant;
+        glm::vec3 ambient;
+        float linear;
+        glm::vec3 diffuse;
+        float quadratic;
+        glm::vec3 specular;
+        // where the attenuation drops the light below 1/256, the light is not binned into clusters past it
+        float radius;
+    };
+
+    // what the last bin() produced
+    struct Stats {
+        unsigned int lights = 0;
+        unsigned int indices = 0;
+        unsigned int occupiedClusters = 0;
+        unsigned int maxPerCluster = 0;
+        double binMs = 0.0;
+    };
+
+    ClusteredLights();
+    ~ClusteredLights();
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // creates the buffers and buffer textures, needs a current GL context
+    void init();
+    // points the samplers of a lit shader at the buffer texture units, once after compiling it
+    void attach(Shader &shader);
+
+    void clear();
+    // lights past MAX_LIGHTS are dropped
+    void add(const glm::vec3 &position, const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular,
+             float constant, float linear, float quadratic);
+
+    // bins the lights into the clusters of a perspective projection, CPU only
+    void bin(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane);
+    // bin() and upload of the three buffers
+    void update(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane);
+    // binds the buffer textures and sets the cluster lookup uniforms for a width x height target
+    void bind(Shader &shader, unsigned int width, unsigned int height);
+
+    std::vector<Light> lights;
+    // false tests the clusters one at a time, to compare with the SSE path
+    bool simd;
+    Stats stats;
+
+private:
+    void buildClusterBounds(const glm::mat4 &projection, float nearPlane, float farPlane);
+    int sliceOf(float depth) const;
+    // sphere against the boxes of clusters first .. first+3, bit i set for an intersection with first+i
+    unsigned int testFour(unsigned int first, const glm::vec3 &center, float radius) const;
+    unsigned int testOne(unsigned int cluster, const glm::vec3 &center, float radius) const;
+
+    unsigned int lightBuffer, gridBuffer, indexBuffer;
+    unsigned int lightTexture, gridTexture, indexTexture;
+
+    // view space boxes of all clusters, structure of arrays for SSE. Depth is positive along the view direction.
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    // box around the TILES_X clusters of a (slice, row), skips whole rows
+    std::vector<float> rowMin, rowMax;
+    glm::mat4 boundsProjection;
+    float nearPlane, farPlane;
+    float sliceScale, sliceBias;
+
+    // reused every frame: packed (cluster << 16 | light) pairs, per cluster (offset, count), the index list
+    std::vector<uint32_t> pairs;
+    std::vector<uint32_t> grid;
+    std::vector<uint16_t> indices;
+};
+
+
+#endif //CLUSTEREDLIGHTS_H
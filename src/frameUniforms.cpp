@@ -0,0 +1,59 @@
+#include "frameUniforms.h"
+
+#include <cstring>
+
+static_assert(sizeof(FrameUniforms::CameraBlock) == 144, "CameraBlock does not match the std140 layout");
+static_assert(sizeof(FrameUniforms::DirLightBlock) == 64, "DirLightBlock does not match the std140 layout");
+static_assert(sizeof(FrameUniforms::PointLightBlock) == 64, "PointLightBlock does not match the std140 layout");
+static_assert(sizeof(FrameUniforms::SpotLightBlock) == 80, "SpotLightBlock does not match the std140 layout");
+static_assert(sizeof(FrameUniforms::RoomLightBlock) == 32, "RoomLightBlock does not match the std140 layout");
+
+FrameUniforms::FrameUniforms()
+{
+    camera = CameraBlock();
+    lights = LightsBlock();
+    uboBuffer = 0;
+    lightsOffset = 0;
+    bufferSize = 0;
+}
+
+void FrameUniforms::init()
+{
+    // the lights block has to start at a multiple of the offset alignment to be bound as a range
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    lightsOffset = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+    bufferSize = lightsOffset + sizeof(LightsBlock);
+    staging.assign(bufferSize, 0);
+
+    glGenBuffers(1, &uboBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, uboBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, bufferSize, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, uboBuffer, 0, sizeof(CameraBlock));
+    glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, uboBuffer, lightsOffset, sizeof(LightsBlock));
+}
+
+void FrameUniforms::attach(Shader &shader)
+{
+    shader.bindUniformBlock("Camera", CAMERA_BINDING);
+    shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+}
+
+void FrameUniforms::setCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &viewPos)
+{
+    camera.projection = projection;
+    camera.view = view;
+    camera.viewPos = viewPos;
+}
+
+void FrameUniforms::upload()
+{
+    std::memcpy(staging.data(), &camera, sizeof(CameraBlock));
+    std::memcpy(staging.data() + lightsOffset, &lights, sizeof(LightsBlock));
+
+    glBindBuffer(GL_UNIFORM_BUFFER, uboBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, bufferSize, staging.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,99 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+
+#include <vector>
+
+#define NR_POINT_LIGHTS 1
+
+// Camera and light state shared by all programs through std140 uniform blocks.
+// Both blocks live in one buffer and are uploaded with a single glBufferSubData per frame.
+// The structs below mirror the GLSL declarations in resources/shaders, every vec3 is followed
+// by a float (or padding) because std140 aligns vec3 to 16 bytes.
+class FrameUniforms {
+public:
+    static const unsigned int CAMERA_BINDING = 0;
+    static const unsigned int LIGHTS_BINDING = 1;
+
+    struct CameraBlock {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 viewPos;
+        float padding;
+    };
+
+    struct DirLightBlock {
+        glm::vec3 direction;
+        float padding0;
+        glm::vec3 ambient;
+        float padding1;
+        glm::vec3 diffuse;
+        float padding2;
+        glm::vec3 specular;
+        float padding3;
+    };
+
+    struct PointLightBlock {
+        glm::vec3 position;
+        float constant;
+        glm::vec3 ambient;
+        float linear;
+        glm::vec3 diffuse;
+        float quadratic;
+        glm::vec3 specular;
+        float padding;
+    };
+
+    struct SpotLightBlock {
+        glm::vec3 position;
+        float cutOff;
+        glm::vec3 direction;
+        float outerCutOff;
+        glm::vec3 ambient;
+        float constant;
+        glm::vec3 diffuse;
+        float linear;
+        glm::vec3 specular;
+        float quadratic;
+    };
+
+    struct RoomLightBlock {
+        glm::vec3 position;
+        float padding0;
+        glm::vec3 color;
+        float padding1;
+    };
+
+    struct LightsBlock {
+        DirLightBlock dirLight;
+        PointLightBlock pointLights[NR_POINT_LIGHTS];
+        SpotLightBlock spotLight;
+        RoomLightBlock roomLight;
+    };
+
+    FrameUniforms();
+    ~FrameUniforms() = default;
+
+    CameraBlock camera;
+    LightsBlock lights;
+
+    // creates the buffer and binds both blocks to their binding points, needs a current GL context
+    void init();
+    // connects the Camera and Lights blocks of a program to the shared binding points
+    void attach(Shader &shader);
+    void setCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &viewPos);
+    // uploads camera and lights in one call
+    void upload();
+
+    unsigned int uboBuffer;
+
+private:
+    unsigned int lightsOffset;
+    unsigned int bufferSize;
+    std::vector<unsigned char> staging;
+};
+
+
+#endif //FRAMEUNIFORMS_H
@@ -0,0 +1,83 @@
+#include "gaussianBlur.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+    std::string blurDefines(const char *direction)
+    {
+        return std::string("#define ") + direction + "\n#define MAX_TAPS " + std::to_string(GaussianBlur::MAX_TAPS) + "\n";
+    }
+}
+
+GaussianBlur::GaussianBlur()
+    : horizontalShader("resources/shaders/blur/blur.vs", "resources/shaders/blur/blur.fs", nullptr, blurDefines("HORIZONTAL").c_str()),
+      verticalShader("resources/shaders/blur/blur.vs", "resources/shaders/blur/blur.fs", nullptr, blurDefines("VERTICAL").c_str())
+{
+    kernelRadius = 0;
+    kernelSigma = 0.0f;
+    tapCount = 0;
+    for (Shader *shader : {&horizontalShader, &verticalShader})
+    {
+        shader->use();
+        shader->setInt("image", 0);
+    }
+    // sigma 1.75 over radius 4 matches the weights the fixed 9-tap blur used
+    setKernel(4, 1.75f);
+}
+
+void GaussianBlur::setKernel(int radius, float sigma)
+{
+    radius = std::max(1, std::min(radius, MAX_RADIUS));
+    sigma = std::max(sigma, 0.1f);
+    if (radius == kernelRadius && sigma == kernelSigma && tapCount != 0)
+        return;
+    kernelRadius = radius;
+    kernelSigma = sigma;
+    tapCount = computeKernel(radius, sigma, weights, offsets);
+    dirty[0] = dirty[1] = true;
+}
+
+Shader &GaussianBlur::use(bool horizontal)
+{
+    Shader &shader = horizontal ? horizontalShader : verticalShader;
+    shader.use();
+    if (dirty[horizontal])
+    {
+        shader.setFloatArray("weights", weights, tapCount);
+        shader.setFloatArray("offsets", offsets, tapCount);
+        shader.setInt("tapCount", tapCount);
+        dirty[horizontal] = false;
+    }
+    return shader;
+}
+
+unsigned int GaussianBlur::computeKernel(int radius, float sigma, float *weights, float *offsets)
+{
+    // discrete weights for texel distances 0 .. radius, normalized over the whole 2r + 1 kernel
+    float texelWeights[MAX_RADIUS + 1];
+    float sum = 0.0f;
+    for (int i = 0; i <= radius; i++)
+    {
+        texelWeights[i] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+        sum += i == 0 ? texelWeights[i] : 2.0f * texelWeights[i];
+    }
+    for (int i = 0; i <= radius; i++)
+        texelWeights[i] /= sum;
+
+    weights[0] = texelWeights[0];
+    offsets[0] = 0.0f;
+    unsigned int taps = 1;
+    for (int i = 1; i <= radius; i += 2)
+    {
+        float first = texelWeights[i];
+        // an odd radius leaves the last texel without a partner
+        float second = i + 1 <= radius ? texelWeights[i + 1] : 0.0f;
+        weights[taps] = first + second;
+        // sampling here with linear filtering returns (first * t_i + second * t_i+1) / (first + second)
+        offsets[taps] = (i * first + (i + 1) * second) / (first + second);
+        taps++;
+    }
+    return taps;
+}
@@ -0,0 +1,46 @@
+#ifndef GAUSSIANBLUR_H
+#define GAUSSIANBLUR_H
+
+#include <learnopengl/shader.h>
+
+// Separable Gaussian blur with weights computed on the CPU for any radius and sigma.
+// Neighbouring taps are merged into one bilinear fetch placed between the two texels by their weights,
+// so a radius r kernel reads 1 + 2 * ceil(r / 2) texels instead of 2r + 1.
+// Horizontal and vertical passes are separate programs compiled from resources/shaders/blur/blur.fs.
+class GaussianBlur {
+public:
+    static const int MAX_RADIUS = 32;
+    // center + one fetch per pair of texels on each side
+    static const int MAX_TAPS = 1 + (MAX_RADIUS + 1) / 2;
+
+    GaussianBlur();
+    ~GaussianBlur() = default;
+
+    // radius in texels (1 .. MAX_RADIUS), sigma in texels
+    void setKernel(int radius, float sigma);
+    int radius() const { return kernelRadius; }
+    float sigma() const { return kernelSigma; }
+    // texture fetches per fragment and pass
+    unsigned int fetches() const { return 2 * tapCount - 1; }
+
+    // makes the program of one direction current, with the kernel and the image sampler set
+    Shader &use(bool horizontal);
+
+    // fills weights/offsets (center first) and returns the number of taps
+    static unsigned int computeKernel(int radius, float sigma, float *weights, float *offsets);
+
+private:
+    Shader horizontalShader;
+    Shader verticalShader;
+
+    int kernelRadius;
+    float kernelSigma;
+    float weights[MAX_TAPS];
+    float offsets[MAX_TAPS];
+    unsigned int tapCount;
+    // the kernel still has to be uploaded to the horizontal / vertical program
+    bool dirty[2];
+};
+
+
+#endif //GAUSSIANBLUR_H
@@ -0,0 +1,171 @@
+#include "instanceBatch.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <cstddef>
+
+InstanceBatch::InstanceBatch(Model &model)
+{
+    // own VAOs, the VAO of the meshes may be shared by every mesh of a GeometryArena
+    for (const Mesh &mesh : model.meshes)
+        parts.push_back({mesh.createVertexArray(), mesh.indexCount, true, &mesh});
+    init();
+}
+
+InstanceBatch::InstanceBatch(unsigned int vao, unsigned int count, bool indexed)
+{
+    parts.push_back({vao, count, indexed, nullptr});
+    init();
+}
+
+InstanceBatch::~InstanceBatch()
+{
+    glDeleteBuffers(1, &buffer);
+    for (const Part &part : parts)
+        glDeleteVertexArrays(1, &part.vao);
+    GLState::get().invalidate();
+}
+
+void InstanceBatch::init()
+{
+    capacity = INITIAL_CAPACITY;
+    dirtyBegin = dirtyEnd = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+
+    // orphaning keeps the buffer name, the attributes stay valid when it grows
+    for (const Part &part : parts)
+    {
+        glBindVertexArray(part.vao);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(MATRIX_ATTRIBUTE + column);
+            glVertexAttribPointer(MATRIX_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(MATRIX_ATTRIBUTE + column, 1);
+        }
+        glEnableVertexAttribArray(COLOR_ATTRIBUTE);
+        glVertexAttribPointer(COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+        glVertexAttribDivisor(COLOR_ATTRIBUTE, 1);
+        glEnableVertexAttribArray(LAYER_ATTRIBUTE);
+        glVertexAttribPointer(LAYER_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, layer));
+        glVertexAttribDivisor(LAYER_ATTRIBUTE, 1);
+    }
+    glBindVertexArray(0);
+    GLState::get().invalidate();
+}
+
+unsigned int InstanceBatch::add(const glm::mat4 &model, const glm::vec4 &color, float layer)
+{
+    InstanceData instance;
+    instance.model = model;
+    instance.color = color;
+    instance.layer = layer;
+    instance.padding[0] = instance.padding[1] = instance.padding[2] = 0.0f;
+    instances.push_back(instance);
+    markDirty(instances.size() - 1);
+    return instances.size() - 1;
+}
+
+void InstanceBatch::setModel(unsigned int index, const glm::mat4 &model)
+{
+    if (instances[index].model == model)
+        return;
+    instances[index].model = model;
+    markDirty(index);
+}
+
+void InstanceBatch::setColor(unsigned int index, const glm::vec4 &color)
+{
+    if (instances[index].color == color)
+        return;
+    instances[index].color = color;
+    markDirty(index);
+}
+
+void InstanceBatch::clear()
+{
+    instances.clear();
+    dirtyBegin = dirtyEnd = 0;
+}
+
+void InstanceBatch::markDirty(unsigned int index)
+{
+    if (dirtyBegin == dirtyEnd)
+    {
+        dirtyBegin = index;
+        dirtyEnd = index + 1;
+        return;
+    }
+    dirtyBegin = std::min(dirtyBegin, index);
+    dirtyEnd = std::max(dirtyEnd, index + 1);
+}
+
+void InstanceBatch::upload()
+{
+    stats.instances = instances.size();
+    stats.uploadedInstances = 0;
+    stats.orphaned = false;
+    if (dirtyBegin == dirtyEnd)
+        return;
+
+    // the array buffer binding is not part of the VAO or the state cache
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (instances.size() > capacity)
+    {
+        // grows by half, the old storage is orphaned instead of waited on
+        capacity = std::max((unsigned int)instances.size(), capacity + capacity / 2);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+        dirtyBegin = 0;
+        dirtyEnd = instances.size();
+        stats.orphaned = true;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(InstanceData), (dirtyEnd - dirtyBegin) * sizeof(InstanceData),
+                    &instances[dirtyBegin]);
+    stats.uploadedInstances = dirtyEnd - dirtyBegin;
+    dirtyBegin = dirtyEnd = 0;
+}
+
+void InstanceBatch::submit(RenderQueue &queue, RenderQueue::Pass pass, Shader &shader, bool cullFace,
+                           std::initializer_list<unsigned int> textures)
+{
+    upload();
+    if (instances.empty())
+        return;
+
+    // the packet model only places the batch in the depth order, the shaders read the instance matrices
+    glm::vec3 center(0.0f);
+    for (const InstanceData &instance : instances)
+        center += glm::vec3(instance.model[3]);
+    center /= (float)instances.size();
+    glm::mat4 placement = glm::translate(glm::mat4(1.0f), center);
+
+    for (const Part &part : parts)
+    {
+        DrawPacket &packet = queue.submit(pass, shader, part.vao, part.count, placement);
+        packet.indexed = part.indexed;
+        packet.instances = instances.size();
+        packet.cullFace = cullFace;
+        packet.hasModel = false;
+        if (part.mesh != nullptr)
+        {
+            packet.baseVertex = part.mesh->baseVertex();
+            packet.firstIndex = part.mesh->firstIndex();
+            packet.indexType = part.mesh->indexType;
+            packet.positionScale = part.mesh->positionScale;
+            packet.positionOffset = part.mesh->positionOffset;
+        }
+        if (textures.size() > 0)
+            packet.setTextures(textures);
+        else if (part.mesh != nullptr)
+        {
+            packet.textureCount = std::min(part.mesh->textures.size(), (size_t)DrawPacket::MAX_TEXTURES);
+            for (unsigned int i = 0; i < packet.textureCount; i++)
+                packet.textures[i] = part.mesh->textures[i].id;
+        }
+    }
+}
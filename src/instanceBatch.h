@@ -0,0 +1,93 @@
+#ifndef INSTANCEBATCH_H
+#define INSTANCEBATCH_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <learnopengl/model.h>
+
+#include <initializer_list>
+#include <vector>
+
+#include "renderQueue.h"
+
+// Per instance attributes, locations 5-8 (model matrix), 9 (color) and 10 (texture array layer)
+struct InstanceData {
+    glm::mat4 model;
+    // multiplies the texture color, alpha included
+    glm::vec4 color;
+    float layer;
+    float padding[3];
+};
+
+// Every copy of a model (or of a VAO that isn't one, like the boxes) drawn with one instanced draw per mesh.
+// The instances live in a vertex buffer whose divisor 1 attributes are added to VAOs the batch owns: one per mesh
+// created over the mesh buffers, or the VAO it was given. The instanced shaders read aInstanceMatrix instead of "model".
+// Changes only mark a dirty range of instances. The next upload sends that range with glBufferSubData,
+// or orphans the buffer with glBufferData when the instances outgrew it.
+class InstanceBatch {
+public:
+    static const unsigned int MATRIX_ATTRIBUTE = 5;
+    static const unsigned int COLOR_ATTRIBUTE = 9;
+    static const unsigned int LAYER_ATTRIBUTE = 10;
+    // texture unit of the GL_TEXTURE_2D_ARRAY the instance layers index, above ClusteredLights::INDEX_UNIT
+    static const unsigned int LAYER_UNIT = 8;
+
+    // what the last upload sent
+    struct Stats {
+        unsigned int instances = 0;
+        unsigned int uploadedInstances = 0;
+        bool orphaned = false;
+    };
+
+    // needs a current GL context and the meshes uploaded
+    explicit InstanceBatch(Model &model);
+    // takes over vao, which has to be made for the batch alone: the instance attributes are added to it
+    // and it is deleted with the batch. count is vertices, or GL_UNSIGNED_INT indices when indexed.
+    InstanceBatch(unsigned int vao, unsigned int count, bool indexed);
+    ~InstanceBatch();
+    InstanceBatch(const InstanceBatch&) = delete;
+    InstanceBatch& operator=(const InstanceBatch&) = delete;
+
+    // returns the index of the instance
+    unsigned int add(const glm::mat4 &model, const glm::vec4 &color = glm::vec4(1.0f), float layer = 0.0f);
+    void setModel(unsigned int index, const glm::mat4 &model);
+    void setColor(unsigned int index, const glm::vec4 &color);
+    void clear();
+    unsigned int size() const { return instances.size(); }
+    const InstanceData &operator[](unsigned int index) const { return instances[index]; }
+
+    // sends the dirty range, submit calls it
+    void upload();
+    // uploads and submits one instanced packet per mesh, sorted by the center of the instances.
+    // textures go to units 0.. of every mesh, without any each mesh binds its own textures.
+    void submit(RenderQueue &queue, RenderQueue::Pass pass, Shader &shader, bool cullFace = true,
+                std::initializer_list<unsigned int> textures = {});
+
+    Stats stats;
+
+private:
+    struct Part {
+        unsigned int vao;
+        unsigned int count;
+        bool indexed;
+        // set for the parts of a model
+        const Mesh *mesh;
+    };
+
+    // instances the buffer has storage for before the first upload, the attributes never point past it
+    static const unsigned int INITIAL_CAPACITY = 16;
+
+    void init();
+    void markDirty(unsigned int index);
+
+    std::vector<Part> parts;
+    std::vector<InstanceData> instances;
+    unsigned int buffer;
+    // instances the buffer has storage for
+    unsigned int capacity;
+    // dirty instances are [dirtyBegin, dirtyEnd)
+    unsigned int dirtyBegin, dirtyEnd;
+};
+
+
+#endif //INSTANCEBATCH_H
@@ -14,32 +14,67 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <thread>
 
 #include "programState.h"
 #include "renderer.h"
 #include "utilities.h"
 #include "character.h"
 #include "scene.h"
+#include "benchmark.h"
+#include "assetLoader.h"
+#include "frameUniforms.h"
+#include "profiler.h"
+#include "bloom.h"
+#include "renderTargets.h"
+#include "pointShadows.h"
+#include "clusteredLights.h"
+#include "instanceBatch.h"
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
+void processCharacterInput(GLFWwindow *window);
+void simulationTick(GLFWwindow *window, bool readInput);
 void stateCheck();
-unsigned int loadCubemap(vector<std::string> faces);
 void DrawImGui(ProgramState *programState);
 
 ProgramState *programState;
 Character *character = new Character();
 Scene *scene = new Scene();
 Renderer renderer;
+Profiler profiler;
+RenderTargets *renderTargets;
+DynamicResolution dynamicResolution;
+PointShadows *pointShadows;
+ClusteredLights *clusteredLights;
 
 // Shadows
 bool shadows = true;
+// PCF disk radius in model_shader.fs and room.fs
+float pcfRadius = 0.04f;
+
+// Depth pre-pass debug view: opaque fragments shaded per pixel as a heat map
+bool overdrawView = false;
+const unsigned int OVERDRAW_COLORS = 8;
+// Diamonds and the transparent box: weighted blended transparency instead of the back to front sort
+bool weightedOit = false;
+// Models are imported with quantized 20 byte vertices (PackedVertex) instead of the 56 byte float Vertex
+bool packedVertices = false;
+// All models are sub-allocated from one vertex and index buffer instead of a VAO, VBO and EBO per mesh
+bool useGeometryArena = true;
+GeometryArena *geometryArena = nullptr;
+// Meshes are deduplicated and reordered for the vertex cache at import, and use 16-bit indices when they fit
+bool optimizeMeshes = true;
+bool shortIndices = true;
 
 // Settings
 const unsigned int SCR_WIDTH = 800;
@@ -47,8 +82,14 @@ const unsigned int SCR_HEIGHT = 600;
 bool bloom = true;
 bool hdr = true;
 bool sharpenEffect = false;
+// bloom composite, tonemap and sharpen in one pass instead of two
+bool fusedPostProcess = false;
 float exposure = 0.7f;
 
+// Headless benchmark (--bench)
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
+const unsigned int BENCH_WARMUP_FRAMES = 30;
+
 // Camera
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
@@ -58,7 +99,89 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main() {
+// Gameplay runs in fixed ticks, the per-tick steps in Character and Scene are tuned for 60 Hz.
+// Character and Scene keep their state from the start of the current tick (beginTick), rendering
+// interpolates from it towards the state at the end of the tick by the fraction of the tick that has passed.
+const float SIMULATION_TIMESTEP = 1.0f / 60.0f;
+// longest frame time that is caught up on, a longer stall slows the game down instead of running hundreds of ticks
+const float MAX_FRAME_TIME = 0.25f;
+float simulationAccumulator = 0.0f;
+
+int main(int argc, char **argv) {
+    // Command line options
+    //----------------------------------------------------------
+    bool benchLoad = false;
+    bool benchUniforms = false;
+    bool benchBloom = false;
+    bool benchArena = false;
+    bool meshStats = false;
+    Bloom::Mode bloomMode = Bloom::PING_PONG;
+    bool bench = false;
+    unsigned int benchFrames = 600;
+    std::string benchOutput = "benchmark.json";
+    std::string benchTrace;
+    int maxFps = -1;
+    float renderScale = 1.0f;
+    PointShadows::Mode shadowMode = PointShadows::PER_FACE;
+    unsigned int extraLights = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench-load")
+            benchLoad = true;
+        else if (arg == "--bench-uniforms")
+            benchUniforms = true;
+        else if (arg == "--bench-bloom")
+            benchBloom = true;
+        else if (arg == "--bench-arena")
+            benchArena = true;
+        else if (arg == "--bloom-mode" && i + 1 < argc)
+            bloomMode = std::string(argv[++i]) == "mip" ? Bloom::MIP_CHAIN : Bloom::PING_PONG;
+        else if (arg == "--fused-post")
+            fusedPostProcess = true;
+        else if (arg == "--bench")
+            bench = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            benchFrames = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--bench-output" && i + 1 < argc)
+            benchOutput = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            benchTrace = argv[++i];
+        else if (arg == "--max-fps" && i + 1 < argc)
+            maxFps = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--shadow-mode" && i + 1 < argc)
+            shadowMode = std::string(argv[++i]) == "layered" ? PointShadows::LAYERED : PointShadows::PER_FACE;
+        else if (arg == "--no-shadows")
+            shadows = false;
+        else if (arg == "--depth-prepass")
+            renderer.queue.depthPrepass = true;
+        else if (arg == "--front-to-back")
+            renderer.queue.order = RenderQueue::FRONT_TO_BACK;
+        else if (arg == "--overdraw")
+            overdrawView = true;
+        else if (arg == "--transparency" && i + 1 < argc)
+            weightedOit = std::string(argv[++i]) == "weighted";
+        else if (arg == "--vertex-format" && i + 1 < argc)
+            packedVertices = std::string(argv[++i]) == "packed";
+        else if (arg == "--geometry" && i + 1 < argc)
+            useGeometryArena = std::string(argv[++i]) != "meshes";
+        else if (arg == "--no-mesh-optimizer")
+            optimizeMeshes = false;
+        else if (arg == "--mesh-stats")
+            meshStats = true;
+        else if (arg == "--index-format" && i + 1 < argc)
+            shortIndices = std::string(argv[++i]) != "32";
+        else if (arg == "--lights" && i + 1 < argc)
+            extraLights = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--render-scale" && i + 1 < argc)
+            renderScale = (float) std::atof(argv[++i]);
+        else if (arg == "--dynamic-resolution" && i + 1 < argc) {
+            dynamicResolution.enabled = true;
+            dynamicResolution.budgetMs = std::max(1.0f, (float) std::atof(argv[++i]));
+        }
+        else
+            std::cout << "Unknown option: " << arg << std::endl;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -69,6 +192,9 @@ int main() {
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    // the benchmark renders into a window that is never shown, e.g. under xvfb-run with llvmpipe
+    if (bench)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // Glfw window creation
     //----------------------------------------------------------
@@ -84,7 +210,11 @@ int main() {
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
     // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!bench)
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // frame rate is not tied to the display when benchmarking or when a frame cap is given
+    if (bench || maxFps >= 0)
+        glfwSwapInterval(0);
 
     // Glad: load all OpenGL function pointers
     //----------------------------------------------------------
@@ -93,8 +223,38 @@ int main() {
         return -1;
     }
 
+    // Cold/warm mesh cache load times for every model, no rendering
+    if (benchLoad) {
+        Benchmark::meshCacheLoad();
+        glfwTerminate();
+        return 0;
+    }
+    // Uniform driver calls per frame with and without the location cache
+    if (benchUniforms) {
+        Benchmark::uniformUpload();
+        glfwTerminate();
+        return 0;
+    }
+    // GPU time of both bloom modes at 800x600, 1080p and 4K
+    if (benchBloom) {
+        Benchmark::bloomModes();
+        glfwTerminate();
+        return 0;
+    }
+
+    // Unload, compact and reload through the geometry arena, checked against the first load
+    if (benchArena) {
+        bool passed = Benchmark::geometryArena();
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+
     programState = new ProgramState;
-    programState->LoadFromFile("resources/program_state.txt");
+    // a benchmark run always starts from the same state
+    if (!bench)
+        programState->LoadFromFile("resources/program_state.txt");
+    else
+        scene->boxColor = Utilities::yellow;
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -123,18 +283,47 @@ int main() {
     //----------------------------------------------------------
     Shader ourShader("resources/shaders/model/model_shader.vs", "resources/shaders/model/model_shader.fs");
     Shader skyboxShader("resources/shaders/skybox/skybox.vs", "resources/shaders/skybox/skybox.fs");
-    Shader brickBoxShader("resources/shaders/basic/shader.vs", "resources/shaders/basic/shader.fs");
+    Shader brickBoxShader("resources/shaders/basic/shader.vs", "resources/shaders/basic/shader.fs", nullptr, "#define INSTANCED\n");
     Shader marioBoxShader("resources/shaders/basic/shader.vs", "resources/shaders/basic/shader.fs");
     Shader diamondShader("resources/shaders/diamond/diamondShader.vs", "resources/shaders/diamond/diamondShader.fs");
+    Shader diamondInstancedShader("resources/shaders/diamond/diamondShader.vs", "resources/shaders/diamond/diamondShader.fs",
+                                  nullptr, "#define INSTANCED\n");
     Shader coinShader("resources/shaders/coin/coinInstancingShader.vs", "resources/shaders/coin/coinInstancingShader.fs");
     Shader starShader("resources/shaders/star/star.vs", "resources/shaders/star/star.fs");
     Shader roomShader("resources/shaders/room/room.vs", "resources/shaders/room/room.fs");
-    Shader blurShader("resources/shaders/blur/blur.vs", "resources/shaders/blur/blur.fs");
     Shader bloomShader("resources/shaders/bloom/bloom.vs", "resources/shaders/bloom/bloom.fs");
     Shader effectShader("resources/shaders/sharpen/effect.vs", "resources/shaders/sharpen/effect.fs");
-    Shader depthShader("resources/shaders/depth/depthShader.vs",
-                       "resources/shaders/depth/depthShader.fs",
-                       "resources/shaders/depth/depthShader.gs");
+    Shader postShader("resources/shaders/post/post.vs", "resources/shaders/post/post.fs");
+    Shader prepassShader("resources/shaders/prepass/prepass.vs", "resources/shaders/prepass/prepass.fs");
+    Shader overdrawShader("resources/shaders/overdraw/overdraw.vs", "resources/shaders/overdraw/overdraw.fs");
+    Shader oitCompositeShader("resources/shaders/oit/composite.vs", "resources/shaders/oit/composite.fs");
+
+    // Depth pre-pass, only for the shaders that compute gl_Position like prepass.vs (the brick boxes are instanced)
+    //----------------------------------------------------------
+    renderer.queue.prepassShader = &prepassShader;
+    for(Shader *shader : {&ourShader, &marioBoxShader})
+        renderer.queue.allowPrepass(*shader);
+
+    // Point light shadow cubemaps, drawn with the depth shaders
+    //----------------------------------------------------------
+    pointShadows = new PointShadows();
+    pointShadows->mode = shadowMode;
+
+    // Point lights binned into view space clusters every frame
+    //----------------------------------------------------------
+    clusteredLights = new ClusteredLights();
+    clusteredLights->init();
+    for(Shader *shader : {&ourShader, &brickBoxShader, &marioBoxShader})
+        clusteredLights->attach(*shader);
+    scene->scatterLights(extraLights);
+
+    // Camera and light uniform blocks shared by all scene shaders
+    //----------------------------------------------------------
+    FrameUniforms frameUniforms;
+    frameUniforms.init();
+    for(Shader *shader : {&ourShader, &skyboxShader, &brickBoxShader, &marioBoxShader, &diamondShader,
+                          &diamondInstancedShader, &coinShader, &starShader, &roomShader, &prepassShader})
+        frameUniforms.attach(*shader);
 
     float boxVertices[] = {
             -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
@@ -237,20 +426,28 @@ int main() {
 
     // Box VAO
     //----------------------------------------------------------
-    unsigned int boxVBO, boxVAO;
+    // the brick boxes get a VAO of their own over the same vertices, their instance batch adds its attributes to it
+    unsigned int boxVBO, boxVAO, brickBoxVAO;
     glGenVertexArrays(1, &boxVAO);
+    glGenVertexArrays(1, &brickBoxVAO);
     glGenBuffers(1, &boxVBO);
 
     glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(boxVertices), boxVertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(boxVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    for (unsigned int vao : {boxVAO, brickBoxVAO}) {
+        glBindVertexArray(vao);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+
+    // Start loading assets on worker threads, they are uploaded in loader.finish()
+    //----------------------------------------------------------
+    AssetLoader loader;
 
     // Load cubemap textures
     //----------------------------------------------------------
@@ -264,109 +461,102 @@ int main() {
                     FileSystem::getPath("resources/textures/skybox/back.jpg")
             };
 
-    unsigned int cubemapTexture = loadCubemap(faces);
+    unsigned int cubemapTexture = 0;
+    loader.loadCubemap(faces, &cubemapTexture);
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
-    // Load Mario cube textures
+    // Load Mario cube textures (flipped vertically)
     //----------------------------------------------------------
-    stbi_set_flip_vertically_on_load(true);
-    unsigned int questionambientMap  = Renderer::loadTexture(FileSystem::getPath("resources/textures/mario_ambient.jpg").c_str(),true);
-    unsigned int questiondiffuseMap  = Renderer::loadTexture(FileSystem::getPath("resources/textures/mario_cube.jpg").c_str(),true);
-    unsigned int questionspecularMap = Renderer::loadTexture(FileSystem::getPath("resources/textures/mario_specular.jpg").c_str(),true);
+    unsigned int questionambientMap = 0, questiondiffuseMap = 0, questionspecularMap = 0;
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario_ambient.jpg"), true, true, &questionambientMap);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario_cube.jpg"), true, true, &questiondiffuseMap);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario_specular.jpg"), true, true, &questionspecularMap);
 
-    // Load brick cube textures
+    // Load brick cube textures (flipped vertically)
     //----------------------------------------------------------
-    unsigned int brickambientMap  = Renderer::loadTexture(FileSystem::getPath("resources/textures/brick_ambient.jpg").c_str(),true);
-    unsigned int brickdiffuseMap  = Renderer::loadTexture(FileSystem::getPath("resources/textures/brick_diffuse.jpg").c_str(),true);
-    unsigned int brickspecularMap = Renderer::loadTexture(FileSystem::getPath("resources/textures/brick_specular.jpg").c_str(),true);
+    unsigned int brickambientMap = 0, brickdiffuseMap = 0, brickspecularMap = 0;
+    loader.loadTexture(FileSystem::getPath("resources/textures/brick_ambient.jpg"), true, true, &brickambientMap);
+    loader.loadTexture(FileSystem::getPath("resources/textures/brick_diffuse.jpg"), true, true, &brickdiffuseMap);
+    loader.loadTexture(FileSystem::getPath("resources/textures/brick_specular.jpg"), true, true, &brickspecularMap);
 
-    // Load hidden room texture
+    // Load hidden room texture (flipped vertically)
     //----------------------------------------------------------
-    unsigned int stoneTexture = Renderer::loadTexture(FileSystem::getPath("resources/textures/stone_texture.jpeg").c_str(), true); // note that we're loading the texture as an SRGB texture
-
+    unsigned int stoneTexture = 0;
+    loader.loadTexture(FileSystem::getPath("resources/textures/stone_texture.jpeg"), true, true, &stoneTexture); // note that we're loading the texture as an SRGB texture
 
-    // Configuring floating point framebuffer
+    // Diamond textures
     //----------------------------------------------------------
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    unsigned int colorBuffers[2];
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        // attach texture to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-    }
+    unsigned int redDiamondTexture = 0, blueDiamondTexture = 0, greenDiamondTexture = 0;
+    unsigned int lightBlueDiamondTexture = 0, yellowDiamondTexture = 0, pinkDiamondTexture = 0;
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/red-transparent.png"), true, false, &redDiamondTexture);
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/blue-transparent.png"), true, false, &blueDiamondTexture);
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/green-transparent.png"), true, false, &greenDiamondTexture);
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/light-blue-transparent.png"), true, false, &lightBlueDiamondTexture);
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/yellow-transparent.png"), true, false, &yellowDiamondTexture);
+    loader.loadTexture(FileSystem::getPath("resources/textures/diamonds/pink-transparent.png"), true, false, &pinkDiamondTexture);
 
-
-    // Create and attach depth buffer (renderbuffer)
+    // Mario textures
     //----------------------------------------------------------
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-    // Ping-pong-framebuffer for blurring
+    unsigned int marioTextureDefault = 0, marioTextureGreen = 0, marioTextureBlue = 0;
+    unsigned int marioTextureLightblue = 0, marioTextureYellow = 0, marioTexturePink = 0;
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/default.jpg"), true, false, &marioTextureDefault);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/green.jpg"), true, false, &marioTextureGreen);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/blue.jpg"), true, false, &marioTextureBlue);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/lightblue.jpg"), true, false, &marioTextureLightblue);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/yellow.jpg"), true, false, &marioTextureYellow);
+    loader.loadTexture(FileSystem::getPath("resources/textures/mario/pink.jpg"), true, false, &marioTexturePink);
+
+    // Load models
     //----------------------------------------------------------
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        // also check if framebuffers are complete (no need for depth buffer)
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
+    Model islandModel, mushroomModel, marioModel, shipModel, diamondModel, coinModel, pipeModel;
+    Model starModel, ghostModel, yellowStarModel, redStarModel, blueStarModel;
+    if (useGeometryArena)
+        geometryArena = new GeometryArena(packedVertices, shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+    for (Model *model : {&islandModel, &mushroomModel, &marioModel, &shipModel, &diamondModel, &coinModel, &pipeModel,
+                         &starModel, &ghostModel, &yellowStarModel, &redStarModel, &blueStarModel}) {
+        model->packVertices = packedVertices;
+        model->arena = geometryArena;
+        model->optimizeMeshes = optimizeMeshes;
+        model->shortIndices = shortIndices;
     }
+    loader.loadModel("resources/objects/island/EO0AAAMXQ0YGMC13XX7X56I3L.obj", &islandModel);
+    loader.loadModel("resources/objects/mushroom/693sxrp8upr3.obj", &mushroomModel);
+    loader.loadModel("resources/objects/mario/1DNSCLY0D1YQZHJRH142C5GI0.obj", &marioModel);
+    loader.loadModel("resources/objects/ship/FBRIPHH48VJVZ9GUIX3KK06PB.obj", &shipModel);
+    loader.loadModel("resources/objects/diamond/diamond.obj", &diamondModel);
+    loader.loadModel("resources/objects/coin/Coin.obj", &coinModel);
+    loader.loadModel("resources/objects/pipe/pipe.obj", &pipeModel);
+    loader.loadModel("resources/objects/star/star.obj", &starModel);
+    loader.loadModel("resources/objects/ghost/dzgtepw5cv4k.obj", &ghostModel);
+    loader.loadModel("resources/objects/marioStar/star.obj", &yellowStarModel);
+    loader.loadModel("resources/objects/redStar/star.obj", &redStarModel);
+    loader.loadModel("resources/objects/blueStar/star.obj", &blueStarModel);
+
+
+    // Offscreen targets at the framebuffer size (larger than the window on retina displays) times the render scale
+    //----------------------------------------------------------
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    renderTargets = new RenderTargets(framebufferWidth, framebufferHeight);
+    renderTargets->setRenderScale(renderScale);
+    renderTargets->bloom.mode = bloomMode;
 
     // Setting uniform in shaders for bloom
     //----------------------------------------------------------
     roomShader.use();
     roomShader.setInt("diffuseTexture", 0);
-//    roomShader.setInt("depthMap", 1);
+    roomShader.setInt("shadowMap", PointShadows::TEXTURE_UNIT);
 
-    blurShader.use();
-    blurShader.setInt("image", 0);
     bloomShader.use();
     bloomShader.setInt("scene", 0);
     bloomShader.setInt("bloomBlur", 1);
 
-    unsigned int effectFBO;
-    unsigned int effectColorBuffer;
-    glGenFramebuffers(1, &effectFBO);
-    glGenTextures(1, &effectColorBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, effectFBO);
-    glBindTexture(GL_TEXTURE_2D, effectColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, effectColorBuffer, 0);
     effectShader.use();
     effectShader.setInt("effectTexture", 0);
+    postShader.use();
+    postShader.setInt("scene", 0);
+    postShader.setInt("bloomBlur", 1);
 
     // Mario cube shader configuration
     //----------------------------------------------------------
@@ -374,6 +564,7 @@ int main() {
     marioBoxShader.setInt("material.ambient", 0);
     marioBoxShader.setInt("material.diffuse", 1);
     marioBoxShader.setInt("material.specular", 2);
+    marioBoxShader.setFloat("material.shininess", 32.0f);
 
     // Brick box shader configuration
     //----------------------------------------------------------
@@ -381,104 +572,66 @@ int main() {
     brickBoxShader.setInt("material.ambient", 0);
     brickBoxShader.setInt("material.diffuse", 1);
     brickBoxShader.setInt("material.specular", 2);
-    stbi_set_flip_vertically_on_load(false);
+    brickBoxShader.setFloat("material.shininess", 32.0f);
+
+    diamondShader.use();
+    diamondShader.setInt("texture1", 0);
+    diamondInstancedShader.use();
+    diamondInstancedShader.setInt("textureLayers", InstanceBatch::LAYER_UNIT);
+
+    oitCompositeShader.use();
+    oitCompositeShader.setInt("accumulation", 0);
+    oitCompositeShader.setInt("weights", 1);
+
+    ourShader.use();
+    ourShader.setInt("texture1", 0);
+    ourShader.setFloat("material.shininess", 32.0f);
+    ourShader.setInt("shadowMap", PointShadows::TEXTURE_UNIT);
+
+    // Coin shader configuration
+    //----------------------------------------------------------
+    coinShader.use();
+    scene->coinSetLights(coinShader);
+    coinShader.setFloat("material.shininess", 32.0f);
+    coinShader.setInt("texture_diffuse1", 0);
+    coinShader.setInt("texture_specular1", 1);
+    coinShader.setInt("texture_normal1", 2);
+
+    // Upload everything the workers have loaded
+    //----------------------------------------------------------
+    loader.finish();
+    loader.printReport();
+    if (meshStats)
+        loader.printMeshReport();
 
     // Diamond positions and textures
     //----------------------------------------------------------
     std::vector< std::pair<glm::vec3, unsigned int> > diamonds;
-
-    unsigned int redDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/red-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-19.0f, -4.0f, 2.0f), redDiamondTexture});
-
-    unsigned int blueDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/blue-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-20.0f, -4.0f, 4.0f), blueDiamondTexture});
-
-    unsigned int greenDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/green-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-19.0f, -4.0f, 6.0f), greenDiamondTexture});
-
-    unsigned int lightBlueDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/light-blue-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-17.0f, -4.0f, 6.0f), lightBlueDiamondTexture});
-
-    unsigned int yellowDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/yellow-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-16.0f, -4.0f, 4.0f), yellowDiamondTexture});
-
-    unsigned int pinkDiamondTexture = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/diamonds/pink-transparent.png").c_str(),true);
     diamonds.push_back({glm::vec3(-17.0f, -4.0f, 2.0f), pinkDiamondTexture});
 
-    diamondShader.use();
-    diamondShader.setInt("texture1", 0);
-
-
-    // Mario textures
-    //----------------------------------------------------------
-    unsigned int marioTextureDefault = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/default.jpg").c_str(),true);
-    unsigned int marioTextureGreen = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/green.jpg").c_str(),true);
-    unsigned int marioTextureBlue = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/blue.jpg").c_str(),true);
-    unsigned int marioTextureLightblue = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/lightblue.jpg").c_str(),true);
-    unsigned int marioTextureYellow = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/yellow.jpg").c_str(),true);
-    unsigned int marioTexturePink = Renderer::loadTexture(
-            FileSystem::getPath("resources/textures/mario/pink.jpg").c_str(),true);
-
-    ourShader.use();
-    ourShader.setInt("texture1", 0);
-
-
-    // Load models
+    // Model texture prefixes
     //----------------------------------------------------------
-    Model islandModel("resources/objects/island/EO0AAAMXQ0YGMC13XX7X56I3L.obj");
     islandModel.SetShaderTextureNamePrefix("material.");
-
-    Model mushroomModel("resources/objects/mushroom/693sxrp8upr3.obj");
     mushroomModel.SetShaderTextureNamePrefix("material.");
-
-    Model marioModel("resources/objects/mario/1DNSCLY0D1YQZHJRH142C5GI0.obj");
     marioModel.SetShaderTextureNamePrefix("material.");
-
-    Model shipModel("resources/objects/ship/FBRIPHH48VJVZ9GUIX3KK06PB.obj");
     shipModel.SetShaderTextureNamePrefix("material.");
-
-    Model diamondModel("resources/objects/diamond/diamond.obj");
     diamondModel.SetShaderTextureNamePrefix("material.");
-
-    Model coinModel("resources/objects/coin/Coin.obj");
     coinModel.SetShaderTextureNamePrefix("material.");
-
-    Model pipeModel("resources/objects/pipe/pipe.obj");
     pipeModel.SetShaderTextureNamePrefix("material.");
-
-    Model starModel("resources/objects/star/star.obj");
-    coinModel.SetShaderTextureNamePrefix("material.");
-
-    Model ghostModel("resources/objects/ghost/dzgtepw5cv4k.obj");
     ghostModel.SetShaderTextureNamePrefix("material.");
-
-    Model yellowStarModel("resources/objects/marioStar/star.obj");
     yellowStarModel.SetShaderTextureNamePrefix("material.");
-
-    Model redStarModel("resources/objects/redStar/star.obj");
     redStarModel.SetShaderTextureNamePrefix("material.");
-
-    Model blueStarModel("resources/objects/blueStar/star.obj");
     blueStarModel.SetShaderTextureNamePrefix("material.");
 
-    // Instancing
+    // Instancing, every model drawn more than once is one instanced draw per mesh
     //----------------------------------------------------------
-    unsigned int coinAmount = 10;
-    glm::mat4* modelMatrices;
-    modelMatrices = new glm::mat4[coinAmount];
-
-    for (unsigned int i = 0; i < coinAmount; i++){
+    InstanceBatch *coinBatch = new InstanceBatch(coinModel);
+    for (unsigned int i = 0; i < 10; i++){
         glm::mat4 modelCoin = glm::mat4(1.0f);
 
         if(i < 4){
@@ -492,383 +645,467 @@ int main() {
 
         modelCoin = glm::scale(modelCoin, glm::vec3(0.01f));
 
-        modelMatrices[i] = modelCoin;
+        coinBatch->add(modelCoin);
+        scene->coinPositions.push_back(glm::vec3(modelCoin[3]));
     }
 
-    unsigned int coinBuffer;
-    glGenBuffers(1, &coinBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, coinBuffer);
-    glBufferData(GL_ARRAY_BUFFER, coinAmount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
-
-    for (unsigned int i = 0; i < coinModel.meshes.size(); i++){
-        unsigned int coinVAO = coinModel.meshes[i].VAO;
-        glBindVertexArray(coinVAO);
-
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *) 0);
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *) (sizeof(glm::vec4)));
-        glEnableVertexAttribArray(7);
-        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *) (2 * sizeof(glm::vec4)));
-        glEnableVertexAttribArray(8);
-        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *) (3 * sizeof(glm::vec4)));
-
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
-        glVertexAttribDivisor(7, 1);
-        glVertexAttribDivisor(8, 1);
-
-        glBindVertexArray(0);
+    // the brick boxes never move, their instances are uploaded once
+    InstanceBatch *brickBoxBatch = new InstanceBatch(brickBoxVAO, 36, false);
+    std::vector<glm::mat4> brickBoxMatrices;
+    for(int i = 0; i < 3; i++){
+        glm::mat4 modelBrickBox = glm::mat4(1.0f);
+        float boxTranslation = (float)i * 1.0f;
+
+        // Make space for Mario box
+        if(i == 2)
+            boxTranslation += 1.0f;
+
+        modelBrickBox = glm::translate(modelBrickBox, glm::vec3(-5.0f, -0.4f, 2.0f - boxTranslation));
+        modelBrickBox = glm::rotate(modelBrickBox, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        modelBrickBox = glm::scale(modelBrickBox, glm::vec3(1.0f));
+
+        brickBoxBatch->add(modelBrickBox);
+        brickBoxMatrices.push_back(modelBrickBox);
     }
 
+    // the diamond textures become the layers of one array, the diamonds are one batch with weighted
+    // transparency (sorted transparency still draws them one by one, back to front)
+    std::vector<unsigned int> diamondTextures;
+    for(std::pair<glm::vec3, unsigned int> diamond : diamonds)
+        diamondTextures.push_back(diamond.second);
+    unsigned int diamondLayers = Renderer::textureArray(diamondTextures, 256);
+    InstanceBatch *diamondBatch = new InstanceBatch(diamondModel);
+    for(unsigned int i = 0; i < diamonds.size(); i++)
+        diamondBatch->add(glm::mat4(1.0f), glm::vec4(1.0f), (float)i);
+
 
     programState->camera.Position = glm::vec3(-14.63f, 0.28f, -7.27f);
     programState->camera.Front = glm::vec3(0.88f, -0.03f, 0.47f);
 
 
+    // Per-pass CPU/GPU timings, the benchmark keeps every frame
+    //----------------------------------------------------------
+    profiler.init();
+    if (bench)
+        profiler.historyLimit = 0;
+    unsigned int benchFrame = 0;
+
+    // Texture uploads and VAO setup above bound objects directly, the state cache starts from scratch
+    GLState &glState = GLState::get();
+    glState.invalidate();
+
+
     // Render loop
     //----------------------------------------------------------
     while (!glfwWindowShouldClose(window)) {
+        profiler.beginFrame();
 
         // Per-frame time logic
         // --------------------
+        if (bench) {
+            // fixed timestep, the animations read glfwGetTime so the clock is set to the simulated time
+            glfwSetTime(benchFrame * BENCH_TIMESTEP);
+            Benchmark::scriptedPath((float) benchFrame / (float) (benchFrames - 1), *programState, *character, *scene);
+        }
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // Input
         // --------------------
-        processInput(window);
-
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (!bench)
+            processInput(window);
 
-
-        // View/projection transformations
-        //----------------------------------------------------------
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
-
-        // Render a chosen character
-        //----------------------------------------------------------
-        ourShader.use();
-        scene->setLights(ourShader, programState);
-        ourShader.setFloat("material.shininess", 32.0f);
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        if(character->currentCharacter == Character::mario){
-            glActiveTexture(GL_TEXTURE0);
-
-            if(character->marioColor == Utilities::red)
-                glBindTexture(GL_TEXTURE_2D, marioTextureDefault);
-            else if(character->marioColor == Utilities::green)
-                glBindTexture(GL_TEXTURE_2D, marioTextureGreen);
-            else if(character->marioColor == Utilities::blue)
-                glBindTexture(GL_TEXTURE_2D, marioTextureBlue);
-            else if(character->marioColor == Utilities::lightblue)
-                glBindTexture(GL_TEXTURE_2D, marioTextureLightblue);
-            else if(character->marioColor == Utilities::yellow)
-                glBindTexture(GL_TEXTURE_2D, marioTextureYellow);
-            else if(character->marioColor == Utilities::pink)
-                glBindTexture(GL_TEXTURE_2D, marioTexturePink);
-
-            renderer.renderMario(ourShader, marioModel, character->characterPosition, character->characterAngle);
-            stateCheck();
-        }
-        else if(character->currentCharacter == Character::ghost){
-            renderer.renderGhost(ourShader, ghostModel, character->characterPosition, character->characterAngle);
-            scene->redStarCheck(*character);
-            scene->blueStarCheck(*character);
+        // Fixed-step simulation
+        // --------------------
+        simulationAccumulator += std::min(deltaTime, MAX_FRAME_TIME);
+        {
+            ProfileScope pass(profiler, "simulation", false);
+            while (simulationAccumulator >= SIMULATION_TIMESTEP) {
+                simulationTick(window, !bench);
+                simulationAccumulator -= SIMULATION_TIMESTEP;
+            }
         }
+        // how far this frame is between the last two ticks
+        float alpha = simulationAccumulator / SIMULATION_TIMESTEP;
 
+        // Internal resolution for this frame, picked from the GPU time of a frame a few frames back
+        //----------------------------------------------------------
+        renderTargets->setRenderScale(dynamicResolution.update(profiler.lastFrame, renderTargets->renderScale()));
 
-// Render models outside of the hidden room
-//-----------------------------------------------------------------
-if(!scene->inside){
-
-        // Coin rendering (instancing)
+        // Draw submission, the shadow pass needs the casters before the scene is drawn
         //----------------------------------------------------------
-        coinShader.use();
-        scene->coinSetLights(coinShader, programState);
-        coinShader.setMat4("projection", projection);
-        coinShader.setMat4("view", view);
-        coinShader.setFloat("material.shininess", 32.0f);
-        coinShader.setInt("texture_diffuse1", 0);
-        coinShader.setInt("texture_specular1", 1);
-        coinShader.setInt("texture_normal1", 2);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, coinModel.textures_loaded[0].id);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, coinModel.textures_loaded[1].id);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, coinModel.textures_loaded[2].id);
-
-        for (unsigned int i = 0; i < coinModel.meshes.size(); i++)
         {
-            glBindVertexArray(coinModel.meshes[i].VAO);
-            glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(
-                    coinModel.meshes[i].indices.size()), GL_UNSIGNED_INT, 0, coinAmount);
-            glBindVertexArray(0);
-        }
+            ProfileScope pass(profiler, "submit", false);
 
+            // View/projection transformations
+            //----------------------------------------------------------
+            glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
+                                                    renderTargets->aspectRatio(), 0.1f, 100.0f);
+            glm::mat4 view = programState->camera.GetViewMatrix();
 
-        // Render other models
-        //----------------------------------------------------------
-        ourShader.use();
-        scene->setLights(ourShader, programState);
-        ourShader.setFloat("material.shininess", 32.0f);
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
+            frameUniforms.setCamera(projection, view, programState->camera.Position);
+            renderer.beginFrame(projection, view);
+            scene->updateLights(frameUniforms, programState);
+            frameUniforms.upload();
 
-        renderer.renderMushroom(ourShader, mushroomModel, scene->mushroomHeight);
-        renderer.renderShip(ourShader, shipModel);
+            {
+                ProfileScope pass(profiler, "light binning", false);
+                clusteredLights->clear();
+                scene->addPointLights(*clusteredLights);
+                clusteredLights->update(projection, view, 0.1f, 100.0f);
+            }
 
-        glDisable(GL_CULL_FACE); // Face culling doesn't work for some models
+            // The shadow casting light is the island light outside and the room light inside
+            //----------------------------------------------------------
+            if (scene->inside)
+                pointShadows->begin(PointShadows::ROOM_LIGHT, scene->roomLightPosition);
+            else
+                pointShadows->begin(PointShadows::ISLAND_LIGHT, scene->lightPos);
+            renderer.shadowCasters = shadows ? pointShadows : nullptr;
+
+            // Render a chosen character
+            //----------------------------------------------------------
+            if(character->currentCharacter == Character::mario){
+                unsigned int marioTexture = marioTextureDefault;
+                if(character->marioColor == Utilities::green)
+                    marioTexture = marioTextureGreen;
+                else if(character->marioColor == Utilities::blue)
+                    marioTexture = marioTextureBlue;
+                else if(character->marioColor == Utilities::lightblue)
+                    marioTexture = marioTextureLightblue;
+                else if(character->marioColor == Utilities::yellow)
+                    marioTexture = marioTextureYellow;
+                else if(character->marioColor == Utilities::pink)
+                    marioTexture = marioTexturePink;
+
+                renderer.renderMario(ourShader, marioModel, character->interpolatedPosition(alpha), character->interpolatedAngle(alpha), marioTexture);
+            }
+            else if(character->currentCharacter == Character::ghost){
+                renderer.renderGhost(ourShader, ghostModel, character->interpolatedPosition(alpha), character->interpolatedAngle(alpha));
+            }
 
-        renderer.renderPipe(ourShader, pipeModel);
-        renderer.renderIsland(ourShader, islandModel);
-        if(!scene->yellowStarCatched)
-            renderer.renderYellowStar(ourShader, yellowStarModel);
 
-        if(!scene->blueStarCatched)
-            renderer.renderBlueStar(ourShader, blueStarModel);
+    // Render models outside of the hidden room
+    //-----------------------------------------------------------------
+    if(!scene->inside){
+
+            // Coin rendering (instancing)
+            //----------------------------------------------------------
+            coinBatch->submit(renderer.queue, RenderQueue::OPAQUE_PASS, coinShader, true,
+                              {coinModel.textures_loaded[0].id, coinModel.textures_loaded[1].id, coinModel.textures_loaded[2].id});
+
+
+            // Render other models
+            //----------------------------------------------------------
+            renderer.renderMushroom(ourShader, mushroomModel, scene->interpolatedMushroomHeight(alpha));
+            renderer.renderShip(ourShader, shipModel);
+
+            // Face culling doesn't work for some models, they are drawn with culling off
+            renderer.renderPipe(ourShader, pipeModel);
+            renderer.renderIsland(ourShader, islandModel);
+            // the stars spin, as casters they would redraw the shadow cubemap every frame
+            renderer.shadowCasters = nullptr;
+            if(!scene->yellowStarCatched)
+                renderer.renderYellowStar(ourShader, yellowStarModel);
+
+            if(!scene->blueStarCatched)
+                renderer.renderBlueStar(ourShader, blueStarModel);
+
+            if(!scene->redStarCatched)
+                renderer.renderRedStar(ourShader, redStarModel);
+
+
+            // Box rendering
+            //----------------------------------------------------------
+            Bounds boxBounds = Bounds::fromBox(glm::vec3(-0.5f), glm::vec3(0.5f));
+
+            // Brick boxes (instancing), the shadow pass still draws them one by one
+            brickBoxBatch->submit(renderer.queue, RenderQueue::OPAQUE_PASS, brickBoxShader, false,
+                                  {brickambientMap, brickdiffuseMap, brickspecularMap});
+            if(shadows)
+                for(const glm::mat4 &modelBrickBox : brickBoxMatrices)
+                    pointShadows->addCaster(boxVAO, 36, false, modelBrickBox, boxBounds);
+
+            // Mario box
+            glm::mat4 modelMarioBox = glm::mat4(1.0f);
+            modelMarioBox = glm::translate(modelMarioBox, glm::vec3(-5.0f, -0.4f, 0.0f));
+            modelMarioBox = glm::rotate(modelMarioBox, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            modelMarioBox = glm::scale(modelMarioBox, glm::vec3(1.0f));
+            DrawPacket &marioBox = renderer.queue.submit(RenderQueue::OPAQUE_PASS, marioBoxShader, boxVAO, 36, modelMarioBox);
+            marioBox.setTextures({questionambientMap, questiondiffuseMap, questionspecularMap});
+            marioBox.cullFace = false;
+            if(shadows)
+                pointShadows->addCaster(boxVAO, 36, false, modelMarioBox, boxBounds);
+
+
+
+            // Transparent box texture (diamond textures are used)
+            //----------------------------------------------------------
+            unsigned int transparentBoxTexture;
+
+            if(scene->boxColor == Utilities::green)
+                transparentBoxTexture = greenDiamondTexture;
+            else if(scene->boxColor == Utilities::blue)
+                transparentBoxTexture = blueDiamondTexture;
+            else if(scene->boxColor == Utilities::lightblue)
+                transparentBoxTexture = lightBlueDiamondTexture;
+            else if(scene->boxColor == Utilities::pink)
+                transparentBoxTexture = pinkDiamondTexture;
+            else if(scene->boxColor == Utilities::yellow)
+                transparentBoxTexture = yellowDiamondTexture;
+            else
+                transparentBoxTexture = redDiamondTexture; // won't happen
+
+            // Diamonds and the box (blending), the queue sorts them back to front
+            //----------------------------------------------------------
+            glm::mat4 modelBox = glm::mat4(1.0f);
+            modelBox = glm::translate(modelBox, scene->interpolatedBoxPosition(alpha));
+            modelBox = glm::scale(modelBox, glm::vec3(1.7f));
+            DrawPacket &transparentBox = renderer.queue.submit(RenderQueue::TRANSPARENT_PASS, diamondShader, boxVAO, 36, modelBox);
+            transparentBox.setTextures({transparentBoxTexture});
+            transparentBox.cullFace = false;
+
+            for(unsigned int i = 0; i < diamonds.size(); i++){
+                glm::mat4 modelDiamond = glm::mat4(1.0f);
+                modelDiamond = glm::translate(modelDiamond, diamonds[i].first);
+                modelDiamond = glm::rotate(modelDiamond, (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
+                modelDiamond = glm::scale(modelDiamond, glm::vec3(0.05f));
+                if(weightedOit)
+                    diamondBatch->setModel(i, modelDiamond);
+                else
+                    renderer.drawModel(diamondShader, diamondModel, modelDiamond, false, RenderQueue::TRANSPARENT_PASS, diamonds[i].second);
+            }
+            if(weightedOit)
+                diamondBatch->submit(renderer.queue, RenderQueue::TRANSPARENT_PASS, diamondInstancedShader, false);
 
-        if(!scene->redStarCatched)
-            renderer.renderRedStar(ourShader, redStarModel);
+    // Render the hidden room
+    //------------------------------------------------------------------
+    }else if(scene->inside){
 
+            // Hidden room rendering
+            //----------------------------------------------------------
+            renderer.renderRoomScene(roomShader, stoneTexture);
 
-        // Box rendering
-        //----------------------------------------------------------
+            renderer.renderRoomPipe(ourShader, pipeModel);
 
-        // Brick box
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, brickambientMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, brickdiffuseMap);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, brickspecularMap);
-
-        brickBoxShader.use();
-        scene->setLights(brickBoxShader, programState);
-        brickBoxShader.setFloat("material.shininess", 32.0f);
-        brickBoxShader.setMat4("projection", projection);
-        brickBoxShader.setMat4("view", view);
-
-        glBindVertexArray(boxVAO);
-        for(int i = 0; i < 3; i++){
-            glm::mat4 modelBrickBox = glm::mat4(1.0f);
-            float boxTranslation = (float)i * 1.0f;
-
-            // Make space for Mario box
-            if(i == 2)
-                boxTranslation += 1.0f;
-
-            modelBrickBox = glm::translate(modelBrickBox, glm::vec3(-5.0f, -0.4f, 2.0f - boxTranslation));
-            modelBrickBox = glm::rotate(modelBrickBox, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            modelBrickBox = glm::scale(modelBrickBox, glm::vec3(1.0f));
-
-            brickBoxShader.setMat4("model", modelBrickBox);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            renderer.shadowCasters = nullptr;
+            if(!scene->starCatched)
+                renderer.renderStar(starShader, starModel);
+    }
+            renderer.shadowCasters = nullptr;
         }
 
-        // Mario box
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, questionambientMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, questiondiffuseMap);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, questionspecularMap);
+        // Shadow cubemap of the current light, skipped when neither the light nor a caster moved
+        //----------------------------------------------------------
+        if (shadows) {
+            ProfileScope pass(profiler, "shadows");
+            pointShadows->render();
+        }
 
-        marioBoxShader.use();
-        scene->setLights(marioBoxShader, programState);
-        marioBoxShader.setFloat("material.shininess", 32.0f);
-        marioBoxShader.setMat4("projection", projection);
-        marioBoxShader.setMat4("view", view);
+        {
+            ProfileScope pass(profiler, "scene");
+            glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
+            glState.bindFramebuffer(0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // everything up to the final pass is drawn at the internal resolution
+            glViewport(0, 0, renderTargets->width(), renderTargets->height());
+            glState.bindFramebuffer(renderTargets->hdrFBO);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+            // the island light only lights the models, the room light only the room
+            glState.bindTexture(PointShadows::TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, pointShadows->texture());
+            for (Shader *shader : {&ourShader, &roomShader}) {
+                shader->use();
+                shader->setBool("shadows", shadows && (shader == &roomShader) == scene->inside);
+                shader->setVec3("shadowLightPos", pointShadows->lightPosition());
+                shader->setFloat("far_plane", pointShadows->farPlane);
+                shader->setFloat("pcfRadius", pcfRadius);
+            }
+            for (Shader *shader : {&ourShader, &brickBoxShader, &marioBoxShader})
+                clusteredLights->bind(*shader, renderTargets->width(), renderTargets->height());
+
+            // Sorted by program, textures and VAO, transparent packets last and back to front
+            //----------------------------------------------------------
+            renderer.queue.countOverdraw = overdrawView;
+            renderer.queue.orderIndependent = weightedOit;
+            for (Shader *shader : {&diamondShader, &diamondInstancedShader}) {
+                shader->use();
+                shader->setBool("weightedOit", weightedOit);
+            }
+            glState.bindTexture(InstanceBatch::LAYER_UNIT, GL_TEXTURE_2D_ARRAY, diamondLayers);
+            renderer.queue.execute(RenderQueue::OPAQUE_PASS);
+            if (!weightedOit)
+                renderer.queue.execute(RenderQueue::TRANSPARENT_PASS);
+
+
+            // Draw skybox as last
+            //----------------------------------------------------------
+            glState.depthFunc(GL_LEQUAL);
+            skyboxShader.use();
+            // Skybox cube
+            glState.bindVertexArray(skyboxVAO);
+            glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glState.depthFunc(GL_LESS);
+
+            // Weighted blended transparency: the transparent packets add up in the OIT targets in any order,
+            // then one full-screen pass blends the result over the opaque scene, before bloom
+            //----------------------------------------------------------
+            if (weightedOit) {
+                glState.bindFramebuffer(renderTargets->oitFBO);
+                const float accumulationClear[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+                const float weightClear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                glClearBufferfv(GL_COLOR, 0, accumulationClear);
+                glClearBufferfv(GL_COLOR, 1, weightClear);
+                glState.blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+                renderer.queue.execute(RenderQueue::TRANSPARENT_PASS);
+
+                glState.bindFramebuffer(renderTargets->hdrFBO);
+                glState.setEnabled(GL_DEPTH_TEST, false);
+                glState.blendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+                oitCompositeShader.use();
+                glState.bindTexture(0, GL_TEXTURE_2D, renderTargets->oitBuffers[0]);
+                glState.bindTexture(1, GL_TEXTURE_2D, renderTargets->oitBuffers[1]);
+                renderer.renderQuad();
+                glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glState.setEnabled(GL_DEPTH_TEST, true);
+            }
 
-        glBindVertexArray(boxVAO);
-        glm::mat4 modelMarioBox = glm::mat4(1.0f);
-        modelMarioBox = glm::translate(modelMarioBox, glm::vec3(-5.0f, -0.4f, 0.0f));
-        modelMarioBox = glm::rotate(modelMarioBox, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        modelMarioBox = glm::scale(modelMarioBox, glm::vec3(1.0f));
-        marioBoxShader.setMat4("model", modelMarioBox);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+            // Overdraw view: the stencil holds how often the opaque pass shaded each pixel,
+            // one full-screen quad per count paints the pixels with that count
+            //----------------------------------------------------------
+            if (overdrawView) {
+                const glm::vec3 heat[OVERDRAW_COLORS] = {
+                        glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.6f), glm::vec3(0.0f, 0.6f, 0.6f),
+                        glm::vec3(0.0f, 0.7f, 0.0f), glm::vec3(0.8f, 0.8f, 0.0f), glm::vec3(1.0f, 0.5f, 0.0f),
+                        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f)
+                };
+                glState.setEnabled(GL_DEPTH_TEST, false);
+                glEnable(GL_STENCIL_TEST);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+                overdrawShader.use();
+                for (unsigned int count = 0; count < OVERDRAW_COLORS; count++) {
+                    // the last color takes every count from there up
+                    glStencilFunc(count + 1 == OVERDRAW_COLORS ? GL_LEQUAL : GL_EQUAL, count, 0xFF);
+                    overdrawShader.setVec3("color", heat[count]);
+                    renderer.renderQuad();
+                }
+                glDisable(GL_STENCIL_TEST);
+                glState.setEnabled(GL_DEPTH_TEST, true);
+            }
 
+            glState.bindFramebuffer(0);
+        }
 
 
-        // Transparent box texture (diamond textures are used)
+        // Blur bright fragments (Gaussian ping-pong or mip chain)
         //----------------------------------------------------------
-        unsigned int transparentBoxTexture;
-
-        if(scene->boxColor == Utilities::green)
-            transparentBoxTexture = greenDiamondTexture;
-        else if(scene->boxColor == Utilities::blue)
-            transparentBoxTexture = blueDiamondTexture;
-        else if(scene->boxColor == Utilities::lightblue)
-            transparentBoxTexture = lightBlueDiamondTexture;
-        else if(scene->boxColor == Utilities::pink)
-            transparentBoxTexture = pinkDiamondTexture;
-        else if(scene->boxColor == Utilities::yellow)
-            transparentBoxTexture = yellowDiamondTexture;
-        else
-            transparentBoxTexture = redDiamondTexture; // won't happen
-
-        std::pair<glm::vec3, unsigned int> transparentBox = {scene->transparentBoxPosition, transparentBoxTexture};
+        unsigned int bloomTexture;
+        {
+            ProfileScope pass(profiler, "blur");
+            bloomTexture = renderTargets->bloom.render(renderTargets->colorBuffers[1], renderer);
+        }
 
-        // Sort and render diamonds and the box (blending)
+        // Bloom composite, tonemapping and sharpening
         //----------------------------------------------------------
-
-        //      distance         translation   texture
-        std::map<float, std::pair<glm::vec3, unsigned int>> diamondsSorted;
-
-        for(std::pair<glm::vec3, unsigned int> diamond : diamonds){
-            float distance = glm::length(programState->camera.Position - diamond.first);
-            diamondsSorted[distance] = diamond;
+        if (fusedPostProcess) {
+            ProfileScope pass(profiler, "post");
+            glState.bindFramebuffer(0);
+            glViewport(0, 0, renderTargets->outputWidth(), renderTargets->outputHeight());
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            postShader.use();
+            glState.bindTexture(0, GL_TEXTURE_2D, renderTargets->colorBuffers[0]);
+            glState.bindTexture(1, GL_TEXTURE_2D, bloomTexture);
+            postShader.setInt("hdr", hdr && !overdrawView);
+            postShader.setInt("bloom", bloom && !overdrawView);
+            postShader.setFloat("exposure", exposure);
+            postShader.setBool("effect", sharpenEffect);
+            renderer.renderQuad();
         }
-        // Add the transparent box to the map so it can be sorted too
-        float boxDistance = glm::length(programState->camera.Position - scene->transparentBoxPosition);
-        diamondsSorted[boxDistance] = transparentBox;
-
-        for(auto diamond = diamondsSorted.rbegin(); diamond != diamondsSorted.rend(); diamond++){
-            if(diamond->second.first == scene->transparentBoxPosition){
-                diamondShader.use();
-                diamondShader.setMat4("projection", projection);
-                diamondShader.setMat4("view", view);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, transparentBoxTexture);
-                glBindVertexArray(boxVAO);
-                glm::mat4 modelBox = glm::mat4(1.0f);
-                modelBox = glm::translate(modelBox, scene->transparentBoxPosition);
-                modelBox = glm::scale(modelBox, glm::vec3(1.7f));
-                diamondShader.setMat4("model", modelBox);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+        else {
+            // Bloom composite into effectFBO, then the sharpen pass reads it back
+            {
+                ProfileScope pass(profiler, "bloom");
+                glState.bindFramebuffer(renderTargets->effectFBO);
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                bloomShader.use();
+                glState.bindTexture(0, GL_TEXTURE_2D, renderTargets->colorBuffers[0]);
+                glState.bindTexture(1, GL_TEXTURE_2D, bloomTexture);
+                bloomShader.setInt("hdr", hdr && !overdrawView);
+                bloomShader.setInt("bloom", bloom && !overdrawView);
+                bloomShader.setFloat("exposure", exposure);
+                renderer.renderQuad();
             }
-            else{
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, diamond->second.second);
-                diamondShader.use();
-                diamondShader.setMat4("projection", projection);
-                diamondShader.setMat4("view", view);
-                glm::mat4 modelDiamond = glm::mat4(1.0f);
-                modelDiamond = glm::translate(modelDiamond, diamond->second.first);
-                modelDiamond = glm::rotate(modelDiamond, (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
-                modelDiamond = glm::scale(modelDiamond, glm::vec3(0.05f));
-                diamondShader.setMat4("model", modelDiamond);
-                diamondModel.Draw(diamondShader);
+
+            // Sharpen effect
+            //----------------------------------------------------------
+            {
+                ProfileScope pass(profiler, "sharpen");
+                glState.bindFramebuffer(0);
+                glViewport(0, 0, renderTargets->outputWidth(), renderTargets->outputHeight());
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                effectShader.use();
+                effectShader.setBool("effect", sharpenEffect);
+                glState.bindTexture(0, GL_TEXTURE_2D, renderTargets->effectColorBuffer);
+
+                renderer.renderQuad();
             }
         }
 
-// Render the hidden room
-//------------------------------------------------------------------
-}else if(scene->inside){
-
-        glDisable(GL_CULL_FACE);
-
-        // Hidden room rendering
-        //----------------------------------------------------------
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, stoneTexture);
-
-        roomShader.use();
-        roomShader.setVec3("lights.Position", scene->roomLightPosition);
-        roomShader.setVec3("lights.Color", scene->roomLightColor);
-        roomShader.setVec3("viewPos", programState->camera.Position);
-
-        roomShader.setMat4("projection", projection);
-        roomShader.setMat4("view", view);
-
-        renderer.renderRoomScene(roomShader);
-
-        ourShader.use();
-        scene->setLights(ourShader, programState);
-        ourShader.setFloat("material.shininess", 32.0f);
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        renderer.renderRoomPipe(ourShader, pipeModel);
-
-        starShader.use();
-        starShader.setMat4("projection", projection);
-        starShader.setMat4("view", view);
-        starShader.setVec3("lightColor", scene->roomLightColor);
-
-        if(!scene->starCatched)
-            renderer.renderStar(starShader, starModel);
-
-        glEnable(GL_CULL_FACE);
-}
-
-
-        // Draw skybox as last
-        //----------------------------------------------------------
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", glm::mat4(glm::mat3(view)));
-        skyboxShader.setMat4("projection", projection);
-        // Skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-        // Blur bright fragments with two-pass Gaussian Blur
+        // Profiler and debug windows
         //----------------------------------------------------------
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 10;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderer.renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+        if (programState->ImGuiEnabled) {
+            ProfileScope pass(profiler, "imgui");
+            DrawImGui(programState);
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, effectFBO);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        bloomShader.setInt("hdr", hdr);
-        bloomShader.setInt("bloom", bloom);
-        bloomShader.setFloat("exposure", exposure);
-        renderer.renderQuad();
-
-        // Sharpen effect
-        //----------------------------------------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        effectShader.use();
-        effectShader.setBool("effect", sharpenEffect);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, effectColorBuffer);
-
-        renderer.renderQuad();
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        // debug check of the state cache against the driver
+        if (glState.validation)
+            glState.validate();
         glfwSwapBuffers(window);
         glfwPollEvents();
+        profiler.endFrame();
+
+        // Frame cap, the simulation does not depend on it
+        if (!bench && maxFps > 0) {
+            double frameEnd = currentFrame + 1.0 / maxFps;
+            while (glfwGetTime() < frameEnd)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        if (bench && ++benchFrame == benchFrames)
+            glfwSetWindowShouldClose(window, true);
     }
 
-    programState->SaveToFile("resources/program_state.txt");
+    if (bench) {
+        profiler.flush();
+        unsigned int warmupFrames = std::min(BENCH_WARMUP_FRAMES, benchFrames / 2);
+        if (Benchmark::writeFrameReport(profiler.history, warmupFrames, BENCH_TIMESTEP,
+                                           renderTargets->width(), renderTargets->height(), benchOutput))
+            std::cout << "Benchmark: " << benchFrames << " frames written to " << benchOutput << std::endl;
+        if (!benchTrace.empty() && profiler.writeChromeTrace(benchTrace))
+            std::cout << "Benchmark: trace written to " << benchTrace << std::endl;
+    }
+    else
+        programState->SaveToFile("resources/program_state.txt");
     delete programState;
+    delete renderTargets;
+    delete pointShadows;
+    delete clusteredLights;
+    delete coinBatch;
+    delete brickBoxBatch;
+    delete diamondBatch;
+    // the meshes go back to the arena and delete their buffers while the context is still current
+    for (Model *model : {&islandModel, &mushroomModel, &marioModel, &shipModel, &diamondModel, &coinModel, &pipeModel,
+                         &starModel, &ghostModel, &yellowStarModel, &redStarModel, &blueStarModel})
+        model->release();
+    delete geometryArena;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -892,7 +1129,11 @@ void processInput(GLFWwindow *window) {
         programState->camera.ProcessKeyboard(LEFT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         programState->camera.ProcessKeyboard(RIGHT, deltaTime);
+}
 
+// character movement is gameplay, it is read once per simulation tick instead of once per frame
+// ---------------------------------------------------------------------------------------------------------
+void processCharacterInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS){
         character->characterAngle += 2.0f;
         if(character->characterAngle >= 360.0f)
@@ -927,9 +1168,11 @@ void processInput(GLFWwindow *window) {
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
+    // the offscreen targets follow the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // The viewport is set per pass, internal resolution for the scene and output size for the final pass.
+    if (renderTargets)
+        renderTargets->setOutputSize(width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -978,6 +1221,210 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Profiler");
+        const Profiler::FrameTiming &frame = profiler.lastFrame;
+        ImGui::Text("Frame %lu: CPU %.2f ms, GPU %.2f ms", frame.index, frame.cpuMs, frame.gpuMs);
+        ImGui::Text("GL state calls: %lu, skipped: %lu", frame.stateCalls, frame.stateCallsSkipped);
+        ImGui::Text("Frames dropped (GPU behind): %lu", profiler.droppedFrames);
+        ImGui::Checkbox("Validate GL state", &GLState::get().validation);
+
+        static float frameTimes[120];
+        unsigned int count = 0;
+        for (auto it = profiler.history.rbegin(); it != profiler.history.rend() && count < 120; ++it)
+            frameTimes[119 - count++] = (float) it->cpuMs;
+        ImGui::PlotLines("CPU ms", frameTimes + 120 - count, count, 0, nullptr, 0.0f, 33.3f, ImVec2(0, 60));
+
+        if (ImGui::BeginTable("passes", 3, ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("CPU ms");
+            ImGui::TableSetupColumn("GPU ms");
+            ImGui::TableHeadersRow();
+            for (const Profiler::PassTiming &pass : frame.passes) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%*s%s", (int) pass.depth * 2, "", pass.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", pass.cpuMs);
+                ImGui::TableNextColumn();
+                if (pass.gpu)
+                    ImGui::Text("%.3f", pass.gpuMs);
+                else
+                    ImGui::Text("-");
+            }
+            ImGui::EndTable();
+        }
+
+        if (ImGui::Button("Save Chrome trace"))
+            profiler.writeChromeTrace("profile_trace.json");
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Bloom");
+        ImGui::Checkbox("Fused composite + sharpen pass", &fusedPostProcess);
+        int mode = renderTargets->bloom.mode;
+        ImGui::RadioButton("Ping-pong Gaussian", &mode, Bloom::PING_PONG);
+        ImGui::RadioButton("Mip chain", &mode, Bloom::MIP_CHAIN);
+        renderTargets->bloom.mode = (Bloom::Mode) mode;
+        if (renderTargets->bloom.mode == Bloom::PING_PONG) {
+            int passes = renderTargets->bloom.pingPongPasses;
+            ImGui::SliderInt("Blur passes", &passes, 2, 20);
+            renderTargets->bloom.pingPongPasses = passes;
+            int radius = renderTargets->bloom.blur.radius();
+            float sigma = renderTargets->bloom.blur.sigma();
+            ImGui::SliderInt("Radius", &radius, 1, GaussianBlur::MAX_RADIUS);
+            ImGui::SliderFloat("Sigma", &sigma, 0.5f, 16.0f);
+            renderTargets->bloom.blur.setKernel(radius, sigma);
+            ImGui::Text("Fetches per pixel and pass: %u (%d without linear sampling)", renderTargets->bloom.blur.fetches(), 2 * radius + 1);
+        } else {
+            int mips = renderTargets->bloom.mipCount;
+            ImGui::SliderInt("Mips", &mips, 1, Bloom::MAX_MIPS);
+            renderTargets->bloom.mipCount = mips;
+            ImGui::SliderFloat("Filter radius", &renderTargets->bloom.filterRadius, 0.5f, 3.0f);
+            ImGui::SliderFloat("Upsample blend", &renderTargets->bloom.upsampleBlend, 0.1f, 1.0f);
+        }
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Resolution");
+        ImGui::Text("Output: %ux%u", renderTargets->outputWidth(), renderTargets->outputHeight());
+        ImGui::Text("Internal: %ux%u (%.0f%%)", renderTargets->width(), renderTargets->height(), renderTargets->renderScale() * 100.0f);
+        ImGui::Text("Reallocations: %u", renderTargets->reallocations());
+        ImGui::Checkbox("Dynamic resolution", &dynamicResolution.enabled);
+        if (dynamicResolution.enabled) {
+            ImGui::SliderFloat("GPU budget ms", &dynamicResolution.budgetMs, 4.0f, 33.3f);
+            ImGui::SliderFloat("Min scale", &dynamicResolution.minScale, RenderTargets::MIN_SCALE, 1.0f);
+            ImGui::SliderFloat("Max scale", &dynamicResolution.maxScale, dynamicResolution.minScale, RenderTargets::MAX_SCALE);
+            ImGui::Text("Average GPU ms: %.2f", dynamicResolution.averageMs);
+        } else {
+            float scale = renderTargets->renderScale();
+            if (ImGui::SliderFloat("Render scale", &scale, RenderTargets::MIN_SCALE, RenderTargets::MAX_SCALE))
+                renderTargets->setRenderScale(scale);
+        }
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Shadows");
+        ImGui::Checkbox("Point light shadows", &shadows);
+        int mode = pointShadows->mode;
+        ImGui::RadioButton("Per face (culled)", &mode, PointShadows::PER_FACE);
+        ImGui::RadioButton("Layered (geometry shader)", &mode, PointShadows::LAYERED);
+        pointShadows->mode = (PointShadows::Mode) mode;
+        int resolution = pointShadows->resolution();
+        ImGui::RadioButton("512", &resolution, 512);
+        ImGui::SameLine();
+        ImGui::RadioButton("1024", &resolution, 1024);
+        ImGui::SameLine();
+        ImGui::RadioButton("2048", &resolution, 2048);
+        pointShadows->setResolution(resolution);
+        ImGui::SliderFloat("Far plane", &pointShadows->farPlane, 5.0f, 100.0f);
+        ImGui::SliderFloat("PCF radius", &pcfRadius, 0.0f, 0.2f);
+        ImGui::Checkbox("Redraw every frame", &pointShadows->alwaysUpdate);
+
+        // GPU time of the last frame with timings, a few frames behind the stats below
+        double shadowMs = 0.0;
+        for (const Profiler::PassTiming &pass : profiler.lastFrame.passes)
+            if (pass.name == "shadows")
+                shadowMs = pass.gpuMs;
+        const PointShadows::Stats &stats = pointShadows->stats;
+        ImGui::Text("Shadow pass GPU: %.3f ms", shadowMs);
+        ImGui::Text("Redrawn this frame: %s", stats.updated ? "yes" : "no");
+        ImGui::Text("Casters: %u, draw calls: %u", stats.casters, stats.drawCalls);
+        ImGui::Text("Redraws: island %u, room %u", stats.updates[PointShadows::ISLAND_LIGHT], stats.updates[PointShadows::ROOM_LIGHT]);
+        ImGui::End();
+    }
+
+    {
+        const ClusteredLights::Stats &stats = clusteredLights->stats;
+        ImGui::Begin("Lights");
+        ImGui::Checkbox("SSE binning", &clusteredLights->simd);
+        ImGui::Text("Point lights: %u", stats.lights);
+        ImGui::Text("Clusters: %u (%ux%ux%u), occupied: %u", ClusteredLights::CLUSTER_COUNT, ClusteredLights::TILES_X,
+                    ClusteredLights::TILES_Y, ClusteredLights::SLICES, stats.occupiedClusters);
+        ImGui::Text("Light indices: %u, most in a cluster: %u", stats.indices, stats.maxPerCluster);
+        ImGui::Text("Binning CPU: %.3f ms", stats.binMs);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Culling");
+        ImGui::Checkbox("Frustum culling", &renderer.frustumCulling);
+        ImGui::Text("Meshes drawn: %u", renderer.cullStats.drawn);
+        ImGui::Text("Meshes culled: %u", renderer.cullStats.culled);
+        ImGui::End();
+    }
+
+    {
+        const RenderQueue::Stats &stats = renderer.queue.stats;
+        ImGui::Begin("Depth pre-pass");
+        ImGui::Checkbox("Depth pre-pass", &renderer.queue.depthPrepass);
+        int order = renderer.queue.order;
+        ImGui::RadioButton("Sorted by state", &order, RenderQueue::STATE_SORTED);
+        ImGui::RadioButton("Front to back", &order, RenderQueue::FRONT_TO_BACK);
+        renderer.queue.order = (RenderQueue::Order) order;
+        ImGui::Checkbox("Overdraw view", &overdrawView);
+        ImGui::Text("Pre-pass draws: %u", stats.prepassDraws);
+
+        double sceneMs = 0.0;
+        for (const Profiler::PassTiming &pass : profiler.lastFrame.passes)
+            if (pass.name == "scene")
+                sceneMs = pass.gpuMs;
+        ImGui::Text("Scene pass GPU: %.3f ms", sceneMs);
+        if (overdrawView) {
+            double pixels = (double) renderTargets->width() * renderTargets->height();
+            ImGui::Text("Opaque fragments shaded: %llu", (unsigned long long) stats.shadedFragments);
+            ImGui::Text("Per pixel: %.2f", stats.shadedFragments / pixels);
+            ImGui::Text("Black 0, blue 1, cyan 2, green 3, yellow 4, orange 5, red 6, white 7+");
+        }
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Transparency");
+        int mode = weightedOit ? 1 : 0;
+        ImGui::RadioButton("Sorted back to front", &mode, 0);
+        ImGui::RadioButton("Weighted blended (unsorted)", &mode, 1);
+        weightedOit = mode == 1;
+        ImGui::Text("Transparent packets: %u", renderer.queue.stats.transparentPackets);
+        ImGui::End();
+    }
+
+    {
+        const RenderQueue::Stats &stats = renderer.queue.stats;
+        ImGui::Begin("Render queue");
+        ImGui::Checkbox("Sort packets", &renderer.queue.sorting);
+        ImGui::Text("Packets: %u", stats.packets);
+        ImGui::Text("Program binds: %u", stats.programBinds);
+        ImGui::Text("Texture binds: %u", stats.textureBinds);
+        ImGui::Text("VAO binds: %u", stats.vaoBinds);
+        ImGui::Text("Cull state changes: %u", stats.stateChanges);
+        ImGui::Text("Binds avoided: %u", stats.bindsAvoided);
+        ImGui::Text("Transparent packets: %u, %s", stats.transparentPackets,
+                    stats.transparentCoherent ? "insertion sorted from last frame" : "radix sorted");
+        ImGui::Text("Insertion sort moves: %u", stats.transparentMoves);
+        ImGui::Checkbox("Multi-draw", &renderer.queue.multiDraw);
+        ImGui::Text("Draw calls: %u, packets merged: %u", stats.drawCalls, stats.mergedPackets);
+        ImGui::End();
+    }
+
+    if (geometryArena != nullptr) {
+        ImGui::Begin("Geometry arena");
+        GeometryArena::Stats stats = geometryArena->stats();
+        ImGui::Text("Meshes: %u", stats.allocations);
+        ImGui::Text("Vertices: %u / %u", stats.vertexUsed, stats.vertexCapacity);
+        ImGui::Text("Indices: %u / %u", stats.indexUsed, stats.indexCapacity);
+        ImGui::Text("Buffers: %.2f MB", geometryArena->capacityBytes() / (1024.0 * 1024.0));
+        ImGui::Text("Holes: %u (%u vertices, %u indices)", stats.freeSpans, stats.holeVertices, stats.holeIndices);
+        ImGui::Text("Fragmentation: vertices %.1f%%, indices %.1f%%",
+                    stats.vertexFragmentation * 100.0f, stats.indexFragmentation * 100.0f);
+        ImGui::Text("Grows: %u, compactions: %u", stats.grows, stats.compactions);
+        if (ImGui::Button("Compact"))
+            geometryArena->compact();
+        ImGui::End();
+    }
+
     {
         ImGui::Begin("Camera info");
         const Camera& c = programState->camera;
@@ -993,6 +1440,17 @@ void DrawImGui(ProgramState *programState) {
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
+        programState->ImGuiEnabled = !programState->ImGuiEnabled;
+        if (programState->ImGuiEnabled) {
+            programState->CameraMouseMovementUpdateEnabled = false;
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        } else {
+            programState->CameraMouseMovementUpdateEnabled = true;
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        }
+    }
+
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS){
         if(character->currentCharacter == Character::mario && !scene->boxRising)
             character->jump = true;
@@ -1060,43 +1518,32 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             else
                 character->currentCharacter = Character::mario;
 
-            character->characterPosition = glm::vec3(-5.0f, -3.0f, 0.2f);
+            character->teleport(glm::vec3(-5.0f, -3.0f, 0.2f));
         }
     }
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
+// one fixed step of gameplay
+// ---------------------------------------------------------------------------------------------------------
+void simulationTick(GLFWwindow *window, bool readInput)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    character->beginTick();
+    scene->beginTick();
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    if (readInput)
+        processCharacterInput(window);
 
-    return textureID;
+    if (character->currentCharacter == Character::mario)
+        stateCheck();
+    else if (character->currentCharacter == Character::ghost) {
+        scene->redStarCheck(*character);
+        scene->blueStarCheck(*character);
+    }
 }
 
 void stateCheck()
 {
+    ProfileScope pass(profiler, "stateCheck", false);
     character->marioColorCheck();
     character->jumpCheck(*scene);
     character->fallCheck();
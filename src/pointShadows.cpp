@@ -0,0 +1,219 @@
+#include "pointShadows.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/gl_state.h>
+
+#include <string>
+
+PointShadows::PointShadows(unsigned int resolution)
+    : layeredShader("resources/shaders/depth/depthShader.vs", "resources/shaders/depth/depthShader.fs",
+                    "resources/shaders/depth/depthShader.gs"),
+      faceShader("resources/shaders/depth/depthShader.vs", "resources/shaders/depth/depthShader.fs",
+                 nullptr, "#define SINGLE_FACE\n")
+{
+    size = resolution;
+    mode = PER_FACE;
+    farPlane = 25.0f;
+    alwaysUpdate = false;
+    light = ISLAND_LIGHT;
+    position = glm::vec3(0.0f);
+    allocate();
+}
+
+PointShadows::~PointShadows()
+{
+    release();
+}
+
+void PointShadows::setResolution(unsigned int resolution)
+{
+    if (resolution == size)
+        return;
+    release();
+    size = resolution;
+    allocate();
+}
+
+void PointShadows::allocate()
+{
+    glGenTextures(LIGHT_COUNT, cubemaps);
+    for (unsigned int i = 0; i < LIGHT_COUNT; i++)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemaps[i]);
+        for (unsigned int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        drawnSignature[i] = 0;
+    }
+
+    // depth only, the attachment is set per render since the two modes attach the cubemap differently
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the bindings above went around the state cache, and deleted ids may have been handed out again
+    GLState::get().invalidate();
+}
+
+void PointShadows::release()
+{
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(LIGHT_COUNT, cubemaps);
+}
+
+void PointShadows::begin(Light light, const glm::vec3 &position)
+{
+    this->light = light;
+    this->position = position;
+    casters.clear();
+}
+
+void PointShadows::addModel(Model &model, const glm::mat4 &modelMatrix)
+{
+    for (Mesh &mesh : model.meshes)
+    {
+        addCaster(mesh.VAO, mesh.indexCount, true, modelMatrix, mesh.bounds);
+        casters.back().baseVertex = mesh.baseVertex();
+        casters.back().firstIndex = mesh.firstIndex();
+        casters.back().indexType = mesh.indexType;
+        casters.back().positionScale = mesh.positionScale;
+        casters.back().positionOffset = mesh.positionOffset;
+    }
+}
+
+void PointShadows::addCaster(unsigned int vao, unsigned int count, bool indexed, const glm::mat4 &modelMatrix, const Bounds &bounds)
+{
+    Caster caster;
+    caster.vao = vao;
+    caster.count = count;
+    caster.indexed = indexed;
+    caster.baseVertex = 0;
+    caster.firstIndex = 0;
+    caster.indexType = GL_UNSIGNED_INT;
+    caster.model = modelMatrix;
+    caster.bounds = bounds;
+    caster.positionScale = glm::vec3(1.0f);
+    caster.positionOffset = glm::vec3(0.0f);
+    casters.push_back(caster);
+}
+
+uint64_t PointShadows::signature() const
+{
+    // FNV-1a over everything the cubemap depends on
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void *data, size_t bytes) {
+        const unsigned char *p = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; i++)
+            hash = (hash ^ p[i]) * 1099511628211ull;
+    };
+    add(&position, sizeof(position));
+    add(&farPlane, sizeof(farPlane));
+    add(&mode, sizeof(mode));
+    for (const Caster &caster : casters)
+    {
+        add(&caster.vao, sizeof(caster.vao));
+        add(&caster.count, sizeof(caster.count));
+        add(&caster.firstIndex, sizeof(caster.firstIndex));
+        add(&caster.model, sizeof(caster.model));
+    }
+    // 0 is reserved for cubemaps that were never drawn
+    return hash != 0 ? hash : 1;
+}
+
+bool PointShadows::render()
+{
+    stats.updated = false;
+    stats.casters = casters.size();
+    stats.drawCalls = 0;
+
+    uint64_t current = signature();
+    if (!alwaysUpdate && current == drawnSignature[light])
+        return false;
+
+    GLState &state = GLState::get();
+    state.bindFramebuffer(framebuffer);
+    glViewport(0, 0, size, size);
+    state.setEnabled(GL_DEPTH_TEST, true);
+    state.depthMask(true);
+    state.depthFunc(GL_LESS);
+    // both sides, the island and pipe are not closed meshes
+    state.setEnabled(GL_CULL_FACE, false);
+
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, farPlane);
+    const glm::vec3 directions[6] = {
+            glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(-1.0f,  0.0f,  0.0f),
+            glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+            glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f)
+    };
+    const glm::vec3 ups[6] = {
+            glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f),
+            glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f,  0.0f, -1.0f),
+            glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)
+    };
+    glm::mat4 shadowMatrices[6];
+    for (unsigned int face = 0; face < 6; face++)
+        shadowMatrices[face] = projection * glm::lookAt(position, position + directions[face], ups[face]);
+
+    if (mode == LAYERED)
+    {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubemaps[light], 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        state.useProgram(layeredShader.ID);
+        for (unsigned int face = 0; face < 6; face++)
+            layeredShader.setMat4("shadowMatrices[" + std::to_string(face) + "]", shadowMatrices[face]);
+        layeredShader.setFloat("far_plane", farPlane);
+        layeredShader.setVec3("lightPos", position);
+        draw(layeredShader, nullptr);
+    }
+    else
+    {
+        state.useProgram(faceShader.ID);
+        faceShader.setFloat("far_plane", farPlane);
+        faceShader.setVec3("lightPos", position);
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubemaps[light], 0);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            faceShader.setMat4("shadowMatrix", shadowMatrices[face]);
+            Frustum frustum(shadowMatrices[face]);
+            draw(faceShader, &frustum);
+        }
+    }
+
+    state.setEnabled(GL_CULL_FACE, true);
+    drawnSignature[light] = current;
+    stats.updated = true;
+    stats.updates[light]++;
+    return true;
+}
+
+void PointShadows::draw(Shader &shader, const Frustum *frustum)
+{
+    GLState &state = GLState::get();
+    // looked up once per cubemap instead of once per caster
+    int modelLocation = shader.uniformLocation("model");
+    int positionScaleLocation = shader.uniformLocation("positionScale");
+    int positionOffsetLocation = shader.uniformLocation("positionOffset");
+    for (const Caster &caster : casters)
+    {
+        if (frustum != nullptr && !frustum->isVisible(caster.bounds, caster.model))
+            continue;
+        state.bindVertexArray(caster.vao);
+        shader.setMat4(modelLocation, caster.model);
+        shader.setVec3(positionScaleLocation, caster.positionScale);
+        shader.setVec3(positionOffsetLocation, caster.positionOffset);
+        if (caster.indexed)
+            glDrawElementsBaseVertex(GL_TRIANGLES, caster.count, caster.indexType,
+                                     (void*)((size_t)caster.firstIndex * IndexSize(caster.indexType)), caster.baseVertex);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, caster.count);
+        stats.drawCalls++;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef POINTSHADOWS_H
+#define POINTSHADOWS_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <learnopengl/model.h>
+
+#include <cstdint>
+#include <vector>
+
+// Omnidirectional shadows of the two point lights (Scene::lightPos on the island, roomLightPosition in
+// the hidden room), stored as linear light distance / farPlane in a depth cubemap per light.
+// Casters are collected every frame with addModel/addCaster and hashed together with the light position.
+// render() only redraws the cubemap when that hash changed since the cubemap was last drawn, so the
+// island pays nothing while Mario stands still.
+// PER_FACE draws the six faces one after another and culls the casters against every face frustum.
+// LAYERED draws all faces in one pass, the geometry shader emits every triangle to all six layers.
+class PointShadows {
+public:
+    enum Mode {
+        PER_FACE = 0,
+        LAYERED = 1
+    };
+
+    enum Light {
+        ISLAND_LIGHT = 0,
+        ROOM_LIGHT = 1,
+        LIGHT_COUNT = 2
+    };
+
+    // what the last render() did
+    struct Stats {
+        bool updated = false;
+        unsigned int casters = 0;
+        unsigned int drawCalls = 0;
+        // cubemap redraws since start, per light
+        unsigned int updates[LIGHT_COUNT] = {};
+    };
+
+    // texture unit the lit shaders sample the shadow cubemap from, above the DrawPacket texture units
+    static const unsigned int TEXTURE_UNIT = 4;
+
+    explicit PointShadows(unsigned int resolution = 1024);
+    ~PointShadows();
+    PointShadows(const PointShadows&) = delete;
+    PointShadows& operator=(const PointShadows&) = delete;
+
+    // reallocates both cubemaps, they are redrawn by the next render
+    void setResolution(unsigned int resolution);
+    unsigned int resolution() const { return size; }
+
+    // starts collecting the casters of the light drawn this frame
+    void begin(Light light, const glm::vec3 &position);
+    void addModel(Model &model, const glm::mat4 &modelMatrix);
+    // non indexed draws count vertices, indexed draws count GL_UNSIGNED_INT indices
+    void addCaster(unsigned int vao, unsigned int count, bool indexed, const glm::mat4 &modelMatrix, const Bounds &bounds);
+    // redraws the cubemap of the current light if it is out of date, returns whether it did.
+    // Changes the framebuffer, viewport and program.
+    bool render();
+
+    // depth cubemap of the current light
+    unsigned int texture() const { return cubemaps[light]; }
+    const glm::vec3 &lightPosition() const { return position; }
+
+    Mode mode;
+    // distance from the light the depth range ends at
+    float farPlane;
+    // redraws every frame, to measure what the cache saves
+    bool alwaysUpdate;
+    Stats stats;
+
+private:
+    struct Caster {
+        unsigned int vao;
+        unsigned int count;
+        bool indexed;
+        // start of an indexed draw in the buffers of the VAO (GeometryArena meshes)
+        int baseVertex;
+        unsigned int firstIndex;
+        unsigned int indexType;
+        glm::mat4 model;
+        Bounds bounds;
+        // position decode of packed meshes
+        glm::vec3 positionScale;
+        glm::vec3 positionOffset;
+    };
+
+    void allocate();
+    void release();
+    uint64_t signature() const;
+    void draw(Shader &shader, const Frustum *frustum);
+
+    unsigned int size;
+    Light light;
+    glm::vec3 position;
+    std::vector<Caster> casters;
+
+    Shader layeredShader;
+    Shader faceShader;
+    unsigned int framebuffer;
+    unsigned int cubemaps[LIGHT_COUNT];
+    // hash of what each cubemap was drawn with, 0 when it has to be drawn
+    uint64_t drawnSignature[LIGHT_COUNT];
+};
+
+
+#endif //POINTSHADOWS_H
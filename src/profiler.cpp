@@ -0,0 +1,180 @@
+#include "profiler.h"
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+
+#include <cstdio>
+#include <iostream>
+
+Profiler::Profiler()
+{
+    lastFrame.index = 0;
+    lastFrame.startMs = 0.0;
+    lastFrame.cpuMs = 0.0;
+    lastFrame.gpuMs = 0.0;
+    lastFrame.stateCalls = 0;
+    lastFrame.stateCallsSkipped = 0;
+    historyLimit = 300;
+    droppedFrames = 0;
+    for(Slot &slot : slots){
+        slot.queryCount = 0;
+        slot.pending = false;
+        for(unsigned int &query : slot.queries)
+            query = 0;
+    }
+    current = nullptr;
+    frameIndex = 0;
+    epoch = Clock::now();
+    gpuPassOpen = false;
+}
+
+void Profiler::init()
+{
+    for(Slot &slot : slots)
+        glGenQueries(MAX_GPU_PASSES, slot.queries);
+}
+
+void Profiler::beginFrame()
+{
+    current = &slots[frameIndex % QUERY_FRAMES];
+    // the queries are reused below, a frame the GPU has not finished yet is given up
+    if(current->pending && !resolve(*current, false)){
+        current->pending = false;
+        droppedFrames++;
+    }
+
+    frameStart = Clock::now();
+    current->frame.index = frameIndex;
+    current->frame.startMs = millisecondsSince(epoch);
+    current->frame.cpuMs = 0.0;
+    current->frame.gpuMs = 0.0;
+    current->frame.passes.clear();
+    current->queryCount = 0;
+    GLState::get().resetCounters();
+}
+
+void Profiler::endFrame()
+{
+    if(current == nullptr)
+        return;
+    while(!openPasses.empty())
+        endPass();
+
+    current->frame.cpuMs = millisecondsSince(frameStart);
+    current->frame.stateCalls = GLState::get().counters.issued;
+    current->frame.stateCallsSkipped = GLState::get().counters.skipped;
+    current->pending = true;
+    current = nullptr;
+    frameIndex++;
+}
+
+void Profiler::beginPass(const char *name, bool gpu)
+{
+    if(current == nullptr)
+        return;
+
+    Clock::time_point start = Clock::now();
+    PassTiming pass;
+    pass.name = name;
+    pass.depth = (unsigned int)openPasses.size();
+    pass.gpu = gpu && !gpuPassOpen && current->queryCount < MAX_GPU_PASSES;
+    pass.startMs = std::chrono::duration<double, std::milli>(start - epoch).count();
+    pass.cpuMs = 0.0;
+    pass.gpuMs = 0.0;
+
+    unsigned int index = (unsigned int)current->frame.passes.size();
+    if(pass.gpu){
+        current->queryPasses[current->queryCount] = index;
+        glBeginQuery(GL_TIME_ELAPSED, current->queries[current->queryCount++]);
+        gpuPassOpen = true;
+    }
+    current->frame.passes.push_back(pass);
+    openPasses.push_back(index);
+    openStarts.push_back(start);
+}
+
+void Profiler::endPass()
+{
+    if(current == nullptr || openPasses.empty())
+        return;
+
+    PassTiming &pass = current->frame.passes[openPasses.back()];
+    if(pass.gpu){
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuPassOpen = false;
+    }
+    pass.cpuMs = millisecondsSince(openStarts.back());
+    openPasses.pop_back();
+    openStarts.pop_back();
+}
+
+void Profiler::flush()
+{
+    // oldest frame first so the history stays in order
+    for(unsigned int i = 0; i < QUERY_FRAMES; i++){
+        Slot &slot = slots[(frameIndex + i) % QUERY_FRAMES];
+        if(slot.pending)
+            resolve(slot, true);
+    }
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) const
+{
+    FILE *out = std::fopen(path.c_str(), "w");
+    if(out == nullptr){
+        std::cout << "Profiler: could not write " << path << std::endl;
+        return false;
+    }
+
+    std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    std::fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+    std::fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+    for(const FrameTiming &frame : history){
+        std::fprintf(out, ",\n{\"name\": \"frame %lu\", \"cat\": \"frame\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+                          "\"ts\": %.3f, \"dur\": %.3f}", frame.index, frame.startMs * 1000.0, frame.cpuMs * 1000.0);
+        for(const PassTiming &pass : frame.passes){
+            std::fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+                              "\"ts\": %.3f, \"dur\": %.3f}", pass.name.c_str(), pass.startMs * 1000.0, pass.cpuMs * 1000.0);
+            if(pass.gpu)
+                std::fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, "
+                                  "\"ts\": %.3f, \"dur\": %.3f}", pass.name.c_str(), pass.startMs * 1000.0, pass.gpuMs * 1000.0);
+        }
+    }
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+    return true;
+}
+
+double Profiler::millisecondsSince(Clock::time_point start) const
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool Profiler::resolve(Slot &slot, bool wait)
+{
+    if(!wait){
+        for(unsigned int i = 0; i < slot.queryCount; i++){
+            GLint available = 0;
+            glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                return false;
+        }
+    }
+
+    slot.frame.gpuMs = 0.0;
+    for(unsigned int i = 0; i < slot.queryCount; i++){
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &nanoseconds);
+        PassTiming &pass = slot.frame.passes[slot.queryPasses[i]];
+        pass.gpuMs = (double)nanoseconds / 1e6;
+        // GPU passes never overlap, their sum is the frame's GPU time
+        slot.frame.gpuMs += pass.gpuMs;
+    }
+    slot.pending = false;
+
+    lastFrame = slot.frame;
+    history.push_back(slot.frame);
+    if(historyLimit != 0 && history.size() > historyLimit)
+        history.pop_front();
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Per-pass CPU and GPU frame timings.
+// Every GPU pass gets a GL_TIME_ELAPSED query from a ring of QUERY_FRAMES sets. Queries of a frame are
+// only read back QUERY_FRAMES frames later, and only when the GPU has finished them: a frame whose results
+// are not available by then is dropped instead of waiting, so measuring never stalls the pipeline.
+class Profiler {
+public:
+    static const unsigned int MAX_GPU_PASSES = 16;
+    static const unsigned int QUERY_FRAMES = 4;
+
+    struct PassTiming {
+        std::string name;
+        unsigned int depth;
+        bool gpu;
+        double startMs;
+        double cpuMs;
+        double gpuMs;
+    };
+
+    struct FrameTiming {
+        unsigned long index;
+        double startMs;
+        double cpuMs;
+        double gpuMs;
+        // GLState calls made and skipped as redundant
+        unsigned long stateCalls;
+        unsigned long stateCallsSkipped;
+        std::vector<PassTiming> passes;
+    };
+
+    Profiler();
+    ~Profiler() = default;
+
+    // creates the query objects, needs a current GL context
+    void init();
+
+    void beginFrame();
+    void endFrame();
+    // passes can be nested, but GL_TIME_ELAPSED queries can not: a pass inside a GPU timed pass
+    // only gets a CPU time
+    void beginPass(const char *name, bool gpu = true);
+    void endPass();
+
+    // reads back every frame still in flight, blocks until the GPU is done with them
+    void flush();
+
+    // writes the recorded history in the Chrome trace event format (chrome://tracing, Perfetto).
+    // GPU passes are drawn on their own track starting at the time they were submitted.
+    bool writeChromeTrace(const std::string &path) const;
+
+    // newest frame whose GPU timings are available
+    FrameTiming lastFrame;
+    // the last historyLimit resolved frames in order, 0 keeps every frame
+    unsigned int historyLimit;
+    std::deque<FrameTiming> history;
+    // frames left out of the history because the GPU was more than QUERY_FRAMES frames behind
+    unsigned long droppedFrames;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slot {
+        FrameTiming frame;
+        unsigned int queries[MAX_GPU_PASSES];
+        unsigned int queryPasses[MAX_GPU_PASSES];
+        unsigned int queryCount;
+        bool pending;
+    };
+
+    double millisecondsSince(Clock::time_point start) const;
+    // reads the queries of a frame into the history. Without wait nothing is read and false is returned
+    // while the GPU has not finished all of them.
+    bool resolve(Slot &slot, bool wait);
+
+    Slot slots[QUERY_FRAMES];
+    Slot *current;
+    unsigned long frameIndex;
+    Clock::time_point epoch;
+    Clock::time_point frameStart;
+    // passes that are still open, innermost last
+    std::vector<unsigned int> openPasses;
+    std::vector<Clock::time_point> openStarts;
+    bool gpuPassOpen;
+};
+
+// Times everything until the end of the enclosing block
+class ProfileScope {
+public:
+    ProfileScope(Profiler &profiler, const char *name, bool gpu = true) : profiler(profiler)
+    {
+        profiler.beginPass(name, gpu);
+    }
+    ~ProfileScope()
+    {
+        profiler.endPass();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler &profiler;
+};
+
+
+#endif //PROFILER_H
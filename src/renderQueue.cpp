@@ -0,0 +1,464 @@
+#include "renderQueue.h"
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+constexpr float RenderQueue::DEPTH_RANGE;
+
+void DrawPacket::setTextures(std::initializer_list<unsigned int> ids)
+{
+    textureCount = 0;
+    for(unsigned int id : ids)
+        if(textureCount < MAX_TEXTURES)
+            textures[textureCount++] = id;
+}
+
+RenderQueue::RenderQueue()
+{
+    sorting = true;
+    order = STATE_SORTED;
+    depthPrepass = false;
+    prepassShader = nullptr;
+    countOverdraw = false;
+    orderIndependent = false;
+    multiDraw = true;
+    cameraPosition = glm::vec3(0.0f);
+    for(unsigned int &query : queries)
+        query = 0;
+    queryFrame = 0;
+    shadedFragments = 0;
+    positionScale = glm::vec3(1.0f);
+    positionOffset = glm::vec3(0.0f);
+    positionDecodeKnown = false;
+}
+
+void RenderQueue::begin(const glm::vec3 &cameraPosition)
+{
+    this->cameraPosition = cameraPosition;
+    packets.clear();
+}
+
+DrawPacket &RenderQueue::submit(Pass pass, Shader &shader, unsigned int vao, unsigned int count, const glm::mat4 &model)
+{
+    packets.emplace_back();
+    DrawPacket &packet = packets.back();
+    packet.pass = pass;
+    packet.shader = &shader;
+    packet.vao = vao;
+    packet.count = count;
+    packet.indexed = false;
+    packet.baseVertex = 0;
+    packet.firstIndex = 0;
+    packet.indexType = GL_UNSIGNED_INT;
+    packet.instances = 0;
+    packet.cullFace = true;
+    packet.hasModel = true;
+    packet.model = model;
+    glm::vec3 offset = glm::vec3(model[3]) - cameraPosition;
+    packet.depth = glm::dot(offset, offset);
+    packet.textureCount = 0;
+    packet.samplerMesh = nullptr;
+    packet.depthVao = std::find(prepassPrograms.begin(), prepassPrograms.end(), shader.ID) != prepassPrograms.end() ? vao : 0;
+    packet.positionScale = glm::vec3(1.0f);
+    packet.positionOffset = glm::vec3(0.0f);
+    packet.intUniform = nullptr;
+    packet.intValue = 0;
+    return packet;
+}
+
+void RenderQueue::allowPrepass(Shader &shader)
+{
+    if(std::find(prepassPrograms.begin(), prepassPrograms.end(), shader.ID) == prepassPrograms.end())
+        prepassPrograms.push_back(shader.ID);
+}
+
+// distance of the packet over [0, DEPTH_RANGE], mapped to [0, 1]
+static float normalizedDepth(const DrawPacket &packet)
+{
+    return std::max(0.0f, std::min(std::sqrt(packet.depth) / RenderQueue::DEPTH_RANGE, 1.0f));
+}
+
+uint64_t RenderQueue::makeKey(const DrawPacket &packet) const
+{
+    float depth = normalizedDepth(packet);
+
+    // textures only group packets, a collision costs binds but never draws with wrong textures
+    uint32_t material = 0;
+    for(unsigned int i = 0; i < packet.textureCount; i++)
+        material = material * 31u + packet.textures[i];
+    material = (material ^ (material >> 16)) & 0xFFFFu;
+
+    uint64_t shader = packet.shader->ID & 0xFFu;
+    uint64_t key = (uint64_t)packet.pass << 62;
+    if(packet.pass == OPAQUE_PASS && order == FRONT_TO_BACK){
+        key |= (uint64_t)(depth * 65535.0f) << 45;
+        key |= (uint64_t)(packet.cullFace ? 0 : 1) << 44;
+        key |= shader << 36;
+        key |= (uint64_t)material << 20;
+        key |= (uint64_t)(packet.vao & 0xFFFFu) << 4;
+    }
+    else{
+        key |= (uint64_t)(packet.cullFace ? 0 : 1) << 61;
+        key |= shader << 53;
+        key |= (uint64_t)material << 37;
+        key |= (uint64_t)(packet.vao & 0xFFFFu) << 16;
+        key |= (uint64_t)(depth * 65535.0f);
+    }
+    return key;
+}
+
+void RenderQueue::sort(std::vector<SortItem> &sorted)
+{
+    if(sorted.empty())
+        return;
+    scratch.resize(sorted.size());
+
+    // LSD radix sort, 8 bits per pass. Stable, so packets with equal keys keep their submission order.
+    for(unsigned int shift = 0; shift < 64; shift += 8){
+        unsigned int offsets[256] = {};
+        for(const SortItem &item : sorted)
+            offsets[(item.key >> shift) & 0xFF]++;
+        // every key has the same byte here, e.g. the unused depth bits of a frame without transparency
+        if(offsets[(sorted[0].key >> shift) & 0xFF] == sorted.size())
+            continue;
+
+        unsigned int sum = 0;
+        for(unsigned int &offset : offsets){
+            unsigned int count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for(const SortItem &item : sorted)
+            scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+        sorted.swap(scratch);
+    }
+}
+
+void RenderQueue::sortTransparent()
+{
+    unsigned int count = items.size();
+    stats.transparentMoves = 0;
+    stats.transparentCoherent = false;
+    if(count == 0){
+        transparentOrder.clear();
+        return;
+    }
+
+    // far to near: the bits of a non-negative float sort like the float, inverted they sort far first.
+    // The low half is the submission index, equal distances keep their submission order.
+    for(unsigned int i = 0; i < count; i++){
+        uint32_t bits;
+        std::memcpy(&bits, &packets[items[i].packet].depth, sizeof(bits));
+        items[i].key = (uint64_t)(~bits) << 32 | i;
+    }
+
+    bool coherent = transparentOrder.size() == count;
+    if(coherent){
+        scratch.resize(count);
+        for(unsigned int i = 0; i < count; i++)
+            scratch[i] = items[transparentOrder[i]];
+        items.swap(scratch);
+
+        // a few neighbours swap per frame when the camera moves, a cut makes the budget run out
+        unsigned int budget = 4 * count + 16;
+        for(unsigned int i = 1; i < count && coherent; i++){
+            SortItem item = items[i];
+            unsigned int j = i;
+            while(j > 0 && items[j - 1].key > item.key){
+                items[j] = items[j - 1];
+                j--;
+                if(++stats.transparentMoves > budget){
+                    coherent = false;
+                    break;
+                }
+            }
+            items[j] = item;
+        }
+    }
+    if(!coherent)
+        sort(items);
+    stats.transparentCoherent = coherent;
+
+    transparentOrder.resize(count);
+    for(unsigned int i = 0; i < count; i++)
+        transparentOrder[i] = (unsigned int)(items[i].key & 0xFFFFFFFFu);
+}
+
+void RenderQueue::executePrepass()
+{
+    // front to back by packet depth, then by VAO
+    prepassItems.clear();
+    for(unsigned int i = 0; i < packets.size(); i++){
+        const DrawPacket &packet = packets[i];
+        if(packet.pass != OPAQUE_PASS || packet.depthVao == 0 || packet.instances > 0)
+            continue;
+        float depth = normalizedDepth(packet);
+        SortItem item;
+        item.key = (uint64_t)(depth * 65535.0f) << 16 | (packet.depthVao & 0xFFFFu);
+        item.packet = i;
+        prepassItems.push_back(item);
+    }
+    if(prepassItems.empty())
+        return;
+    sort(prepassItems);
+
+    GLState &state = GLState::get();
+    bool programChanged = state.useProgram(prepassShader->ID);
+    const UniformLocations &locations = uniformLocations(*prepassShader);
+    positionDecodeKnown = false;
+    state.depthFunc(GL_LESS);
+    state.depthMask(true);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    for(unsigned int i = 0; i < prepassItems.size();){
+        const DrawPacket &packet = packets[prepassItems[i].packet];
+        state.bindVertexArray(packet.depthVao);
+        state.setEnabled(GL_CULL_FACE, packet.cullFace);
+        prepassShader->setMat4(locations.model, packet.model);
+        setPositionDecode(*prepassShader, locations, packet, programChanged);
+        programChanged = false;
+        unsigned int run = mergeableRun(prepassItems, i, true);
+        draw(prepassItems, i, run);
+        stats.prepassDraws++;
+        i += run;
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+const RenderQueue::UniformLocations &RenderQueue::uniformLocations(const Shader &shader)
+{
+    // a handful of programs go through the queue, a linear search is enough
+    for(UniformLocations &locations : programLocations){
+        if(locations.program != shader.ID)
+            continue;
+        // without the location cache every lookup goes to the driver, like the setters do
+        if(!Shader::locationCacheEnabled()){
+            locations.model = shader.uniformLocation("model");
+            locations.positionScale = shader.uniformLocation("positionScale");
+            locations.positionOffset = shader.uniformLocation("positionOffset");
+        }
+        return locations;
+    }
+    UniformLocations locations;
+    locations.program = shader.ID;
+    locations.model = shader.uniformLocation("model");
+    locations.positionScale = shader.uniformLocation("positionScale");
+    locations.positionOffset = shader.uniformLocation("positionOffset");
+    programLocations.push_back(locations);
+    return programLocations.back();
+}
+
+void RenderQueue::setPositionDecode(const Shader &shader, const UniformLocations &locations, const DrawPacket &packet,
+                                    bool programChanged)
+{
+    if(positionDecodeKnown && !programChanged && packet.positionScale == positionScale && packet.positionOffset == positionOffset)
+        return;
+    shader.setVec3(locations.positionScale, packet.positionScale);
+    shader.setVec3(locations.positionOffset, packet.positionOffset);
+    positionScale = packet.positionScale;
+    positionOffset = packet.positionOffset;
+    positionDecodeKnown = true;
+}
+
+unsigned int RenderQueue::mergeableRun(const std::vector<SortItem> &list, unsigned int first, bool depthOnly) const
+{
+    const DrawPacket &packet = packets[list[first].packet];
+    if(!multiDraw || !packet.indexed || packet.instances > 0)
+        return 1;
+
+    unsigned int run = 1;
+    for(unsigned int i = first + 1; i < list.size(); i++, run++){
+        const DrawPacket &next = packets[list[i].packet];
+        if(!next.indexed || next.instances > 0 || next.indexType != packet.indexType || next.cullFace != packet.cullFace || next.model != packet.model ||
+           next.positionScale != packet.positionScale || next.positionOffset != packet.positionOffset)
+            break;
+        // the pre-pass only binds the position stream
+        if(depthOnly){
+            if(next.depthVao != packet.depthVao)
+                break;
+            continue;
+        }
+        // equal textures are assumed to be bound to the same samplers
+        if(next.shader != packet.shader || next.vao != packet.vao || next.hasModel != packet.hasModel ||
+           (next.depthVao != 0) != (packet.depthVao != 0) || next.textureCount != packet.textureCount ||
+           (next.samplerMesh == nullptr) != (packet.samplerMesh == nullptr) ||
+           !std::equal(packet.textures, packet.textures + packet.textureCount, next.textures) ||
+           next.intUniform != packet.intUniform || next.intValue != packet.intValue)
+            break;
+    }
+    return run;
+}
+
+void RenderQueue::draw(const std::vector<SortItem> &list, unsigned int first, unsigned int run)
+{
+    const DrawPacket &packet = packets[list[first].packet];
+    stats.drawCalls++;
+    if(run > 1){
+        multiCounts.clear();
+        multiIndices.clear();
+        multiBaseVertices.clear();
+        for(unsigned int i = first; i < first + run; i++){
+            const DrawPacket &merged = packets[list[i].packet];
+            multiCounts.push_back(merged.count);
+            multiIndices.push_back((const void*)((size_t)merged.firstIndex * IndexSize(merged.indexType)));
+            multiBaseVertices.push_back(merged.baseVertex);
+        }
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, multiCounts.data(), packet.indexType, multiIndices.data(), run,
+                                      multiBaseVertices.data());
+        stats.mergedPackets += run - 1;
+        return;
+    }
+
+    const void *indices = (const void*)((size_t)packet.firstIndex * IndexSize(packet.indexType));
+    if(packet.indexed && packet.instances > 0)
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.count, packet.indexType, indices, packet.instances, packet.baseVertex);
+    else if(packet.indexed)
+        glDrawElementsBaseVertex(GL_TRIANGLES, packet.count, packet.indexType, indices, packet.baseVertex);
+    else if(packet.instances > 0)
+        glDrawArraysInstanced(GL_TRIANGLES, 0, packet.count, packet.instances);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, packet.count);
+}
+
+void RenderQueue::readQuery()
+{
+    // the query about to be reused is the oldest one, begun QUERY_FRAMES frames ago
+    if(queryFrame < QUERY_FRAMES)
+        return;
+    unsigned int query = queries[queryFrame % QUERY_FRAMES];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(available){
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &samples);
+        shadedFragments = samples;
+    }
+}
+
+void RenderQueue::execute()
+{
+    execute(OPAQUE_PASS);
+    execute(TRANSPARENT_PASS);
+    packets.clear();
+}
+
+void RenderQueue::execute(Pass pass)
+{
+    // the stats cover both passes of a frame
+    if(pass == OPAQUE_PASS){
+        stats = Stats();
+        stats.packets = packets.size();
+        stats.shadedFragments = shadedFragments;
+    }
+
+    // opaque packets by state, transparent ones back to front or by state when their order doesn't matter
+    bool stateSorted = pass == OPAQUE_PASS || orderIndependent;
+    items.clear();
+    for(unsigned int i = 0; i < packets.size(); i++){
+        if(packets[i].pass != pass)
+            continue;
+        SortItem item;
+        item.key = sorting && stateSorted ? makeKey(packets[i]) : 0;
+        item.packet = i;
+        items.push_back(item);
+    }
+    if(pass == TRANSPARENT_PASS)
+        stats.transparentPackets = items.size();
+    if(items.empty())
+        return;
+    if(sorting && stateSorted)
+        sort(items);
+    else if(sorting)
+        sortTransparent();
+
+    // the state cache remembers what previous packets and frames left bound
+    GLState &state = GLState::get();
+    Mesh *samplerMesh = nullptr;
+    positionDecodeKnown = false;
+
+    bool prepass = pass == OPAQUE_PASS && depthPrepass && prepassShader != nullptr;
+    if(prepass)
+        executePrepass();
+
+    // every fragment that passes the depth test increments the stencil, the query counts them too.
+    // Only the opaque pass is counted.
+    bool counting = pass == OPAQUE_PASS && countOverdraw;
+    if(counting){
+        if(queries[0] == 0)
+            glGenQueries(QUERY_FRAMES, queries);
+        readQuery();
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+        glBeginQuery(GL_SAMPLES_PASSED, queries[queryFrame % QUERY_FRAMES]);
+    }
+    // order independent transparency accumulates, nothing may be hidden by a transparent surface
+    if(pass == TRANSPARENT_PASS){
+        state.depthFunc(GL_LESS);
+        state.depthMask(!orderIndependent);
+    }
+
+    for(unsigned int i = 0; i < items.size();){
+        const DrawPacket &packet = packets[items[i].packet];
+
+        // packets the pre-pass drew only shade the fragments that are left visible
+        if(pass == OPAQUE_PASS){
+            bool equalDepth = prepass && packet.depthVao != 0 && packet.instances == 0;
+            state.depthFunc(equalDepth ? GL_EQUAL : GL_LESS);
+            state.depthMask(!equalDepth);
+        }
+        bool programChanged = state.useProgram(packet.shader->ID);
+        if(programChanged){
+            samplerMesh = nullptr;
+            stats.programBinds++;
+        }
+        else
+            stats.bindsAvoided++;
+
+        if(packet.samplerMesh != nullptr && packet.samplerMesh != samplerMesh){
+            packet.samplerMesh->setSamplers(*packet.shader);
+            samplerMesh = packet.samplerMesh;
+        }
+
+        for(unsigned int unit = 0; unit < packet.textureCount; unit++){
+            if(state.bindTexture(unit, GL_TEXTURE_2D, packet.textures[unit]))
+                stats.textureBinds++;
+            else
+                stats.bindsAvoided++;
+        }
+
+        if(state.bindVertexArray(packet.vao))
+            stats.vaoBinds++;
+        else
+            stats.bindsAvoided++;
+
+        if(state.setEnabled(GL_CULL_FACE, packet.cullFace))
+            stats.stateChanges++;
+        else
+            stats.bindsAvoided++;
+
+        const UniformLocations &locations = uniformLocations(*packet.shader);
+        if(packet.hasModel)
+            packet.shader->setMat4(locations.model, packet.model);
+        setPositionDecode(*packet.shader, locations, packet, programChanged);
+        if(packet.intUniform != nullptr)
+            packet.shader->setInt(packet.intUniform, packet.intValue);
+
+        unsigned int run = mergeableRun(items, i, false);
+        draw(items, i, run);
+        i += run;
+    }
+
+    if(counting){
+        glEndQuery(GL_SAMPLES_PASSED);
+        glDisable(GL_STENCIL_TEST);
+        queryFrame++;
+    }
+
+    state.setEnabled(GL_CULL_FACE, true);
+    state.depthFunc(GL_LESS);
+    state.depthMask(true);
+}
@@ -0,0 +1,194 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <learnopengl/mesh.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// Everything needed to issue one draw call, recorded instead of drawn immediately
+struct DrawPacket {
+    static const unsigned int MAX_TEXTURES = 4;
+
+    // RenderQueue::Pass
+    unsigned int pass;
+    Shader *shader;
+    unsigned int vao;
+    // index count for indexed draws, vertex count otherwise
+    unsigned int count;
+    bool indexed;
+    // where an indexed draw starts in the buffers of the VAO, non zero for meshes in a GeometryArena
+    int baseVertex;
+    unsigned int firstIndex;
+    // GL_UNSIGNED_INT, or GL_UNSIGNED_SHORT for meshes uploaded with 16-bit indices
+    unsigned int indexType;
+    // 0 draws without instancing
+    unsigned int instances;
+    bool cullFace;
+    // false for draws whose vertex shader doesn't read "model" (instanced coins)
+    bool hasModel;
+    glm::mat4 model;
+    // squared distance from the camera, sets the order inside a pass
+    float depth;
+
+    // bound to units 0 .. textureCount-1
+    unsigned int textures[MAX_TEXTURES];
+    unsigned int textureCount;
+    // mesh whose sampler uniforms are pointed at the units, null when the samplers are set once at init
+    Mesh *samplerMesh;
+    // VAO the depth pre-pass draws, attribute 0 is the position. 0 keeps the packet out of the pre-pass.
+    unsigned int depthVao;
+    // position decode of packed meshes (Mesh::positionScale/positionOffset), identity otherwise
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+
+    // optional per draw int uniform (inverse_normals of the room)
+    const char *intUniform;
+    int intValue;
+
+    void setTextures(std::initializer_list<unsigned int> ids);
+};
+
+// Draw packets of a frame, sorted by a 64-bit key before they are executed so draws sharing a program,
+// textures and VAO end up next to each other. Execution then only touches the state that differs from
+// the previous packet.
+//
+// Key layout, most significant bits first:
+//   opaque:        pass (2) | no cull (1) | shader (8) | material (16) | VAO (16) | depth front to back (16)
+//   front to back: pass (2) | depth front to back (16) | no cull (1) | shader (8) | material (16) | VAO (16)
+//
+// Transparent packets have to blend in order and are sorted on their own, back to front by the exact
+// squared distance with the submission index breaking ties. Their order barely changes between frames,
+// so the sort starts from last frame's order and finishes it with an insertion sort. It falls back to
+// the radix sort when the packet count changed or the insertion sort runs out of its move budget.
+//
+// With the depth pre-pass, opaque packets of the shaders registered with allowPrepass are first drawn
+// front to back with prepassShader and color writes off. The lit pass then draws them with GL_EQUAL and
+// no depth writes, so every pixel runs the lit fragment shader once. Those vertex shaders have to
+// compute gl_Position exactly like prepass.vs (invariant, same expression).
+//
+// With multiDraw, runs of sorted indexed packets that only differ in baseVertex, firstIndex and count
+// (meshes of one model in a GeometryArena with the same textures) go out as one glMultiDrawElementsBaseVertex.
+class RenderQueue {
+public:
+    enum Pass {
+        OPAQUE_PASS = 0,
+        TRANSPARENT_PASS = 1
+    };
+
+    // order of the opaque packets
+    enum Order {
+        STATE_SORTED = 0,
+        FRONT_TO_BACK = 1
+    };
+
+    // depth is quantized over [0, DEPTH_RANGE], the far plane of the projection
+    static constexpr float DEPTH_RANGE = 100.0f;
+
+    // state changes issued and skipped by the last execute
+    struct Stats {
+        unsigned int packets = 0;
+        unsigned int programBinds = 0;
+        unsigned int vaoBinds = 0;
+        unsigned int textureBinds = 0;
+        unsigned int stateChanges = 0;
+        unsigned int bindsAvoided = 0;
+        unsigned int prepassDraws = 0;
+        // draw calls issued, packets merged into a multi-draw count once
+        unsigned int drawCalls = 0;
+        unsigned int mergedPackets = 0;
+        unsigned int transparentPackets = 0;
+        // insertion sort moves, false when the transparent packets were radix sorted
+        unsigned int transparentMoves = 0;
+        bool transparentCoherent = false;
+        // fragments the opaque lit pass shaded, from a query a few frames old. 0 until countOverdraw is on.
+        uint64_t shadedFragments = 0;
+    };
+
+    RenderQueue();
+    // the queries go with the context, the queue lives in a global that outlives it
+    ~RenderQueue() = default;
+
+    // camera position the packet depths are measured from
+    void begin(const glm::vec3 &cameraPosition);
+    DrawPacket &submit(Pass pass, Shader &shader, unsigned int vao, unsigned int count, const glm::mat4 &model);
+    // packets of shader take part in the depth pre-pass, non instanced ones only
+    void allowPrepass(Shader &shader);
+    // sorts and draws everything submitted since begin through the GLState cache,
+    // face culling is left on and the depth test at GL_LESS with writes
+    void execute();
+    // sorts and draws the packets of one pass, for passes that need their own framebuffer or blending
+    void execute(Pass pass);
+
+    bool sorting;
+    Order order;
+    bool depthPrepass;
+    // position only shader of the pre-pass, the pre-pass is skipped without one
+    Shader *prepassShader;
+    // counts the fragments the opaque lit pass shades in the stencil buffer (the overdraw view reads it)
+    // and with an occlusion query
+    bool countOverdraw;
+    // transparent packets are drawn grouped by state in any order and without depth writes, for
+    // weighted blended transparency (the caller sets up the targets and blending)
+    bool orderIndependent;
+    // merges runs of packets into glMultiDrawElementsBaseVertex
+    bool multiDraw;
+    Stats stats;
+
+private:
+    struct SortItem {
+        uint64_t key;
+        unsigned int packet;
+    };
+
+    // locations of the uniforms every packet sets, resolved once per program
+    struct UniformLocations {
+        unsigned int program;
+        int model;
+        int positionScale;
+        int positionOffset;
+    };
+
+    // queries in flight, the oldest is read back when its result is available
+    static const unsigned int QUERY_FRAMES = 3;
+
+    uint64_t makeKey(const DrawPacket &packet) const;
+    void sort(std::vector<SortItem> &sorted);
+    void sortTransparent();
+    void executePrepass();
+    void readQuery();
+    const UniformLocations &uniformLocations(const Shader &shader);
+    // sets the decode uniforms of shader when the program changed or the packet decodes differently than the last one
+    void setPositionDecode(const Shader &shader, const UniformLocations &locations, const DrawPacket &packet, bool programChanged);
+    // number of packets from first on in list that draw with the same state as list[first], at least 1
+    unsigned int mergeableRun(const std::vector<SortItem> &list, unsigned int first, bool depthOnly) const;
+    // draws the packets list[first .. first+run), one packet or a multi-draw of all of them
+    void draw(const std::vector<SortItem> &list, unsigned int first, unsigned int run);
+
+    glm::vec3 cameraPosition;
+    std::vector<unsigned int> prepassPrograms;
+    std::vector<UniformLocations> programLocations;
+    unsigned int queries[QUERY_FRAMES];
+    unsigned int queryFrame;
+    uint64_t shadedFragments;
+    // decode last set on the bound program, unknown at the start of every pass
+    glm::vec3 positionScale, positionOffset;
+    bool positionDecodeKnown;
+    std::vector<DrawPacket> packets;
+    // reused every frame, the queue doesn't allocate once it has seen its largest frame
+    std::vector<SortItem> items;
+    // submission index (among the transparent packets) of each position after last frame's sort
+    std::vector<unsigned int> transparentOrder;
+    std::vector<SortItem> prepassItems;
+    std::vector<SortItem> scratch;
+    // arguments of glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> multiCounts;
+    std::vector<const void*> multiIndices;
+    std::vector<GLint> multiBaseVertices;
+};
+
+
+#endif //RENDERQUEUE_H
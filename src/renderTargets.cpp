@@ -0,0 +1,182 @@
+#include "renderTargets.h"
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+constexpr float RenderTargets::MIN_SCALE;
+constexpr float RenderTargets::MAX_SCALE;
+
+RenderTargets::RenderTargets(unsigned int outputWidth, unsigned int outputHeight)
+    : bloom(std::max(1u, outputWidth), std::max(1u, outputHeight))
+{
+    scale = 1.0f;
+    outWidth = std::max(1u, outputWidth);
+    outHeight = std::max(1u, outputHeight);
+    internalWidth = outWidth;
+    internalHeight = outHeight;
+    reallocationCount = 0;
+    allocate();
+}
+
+RenderTargets::~RenderTargets()
+{
+    release();
+}
+
+void RenderTargets::setOutputSize(unsigned int width, unsigned int height)
+{
+    if (width == 0 || height == 0)
+        return;
+    outWidth = width;
+    outHeight = height;
+    update();
+}
+
+void RenderTargets::setRenderScale(float scale)
+{
+    this->scale = std::max(MIN_SCALE, std::min(scale, MAX_SCALE));
+    update();
+}
+
+void RenderTargets::update()
+{
+    unsigned int width = std::max(1u, (unsigned int)std::lround(outWidth * scale));
+    unsigned int height = std::max(1u, (unsigned int)std::lround(outHeight * scale));
+    if (width == internalWidth && height == internalHeight)
+        return;
+
+    release();
+    internalWidth = width;
+    internalHeight = height;
+    allocate();
+    bloom.resize(width, height);
+    reallocationCount++;
+}
+
+void RenderTargets::allocate()
+{
+    // Floating point framebuffer
+    //----------------------------------------------------------
+    glGenFramebuffers(1, &hdrFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    glGenTextures(2, colorBuffers);
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, internalWidth, internalHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+        // linear, the final pass upsamples when the render scale is below 1
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // attach texture to framebuffer
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
+    }
+
+    // Depth and stencil buffer (renderbuffer), the stencil counts overdraw for the debug view
+    //----------------------------------------------------------
+    glGenRenderbuffers(1, &rboDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, internalWidth, internalHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Framebuffer not complete!" << std::endl;
+
+    // Weighted blended transparency targets, sharing the depth buffer
+    //----------------------------------------------------------
+    glGenFramebuffers(1, &oitFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, oitFBO);
+    glGenTextures(2, oitBuffers);
+    const GLenum oitFormats[2] = { GL_RGBA16F, GL_R16F };
+    const GLenum oitLayouts[2] = { GL_RGBA, GL_RED };
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, oitBuffers[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, oitFormats[i], internalWidth, internalHeight, 0, oitLayouts[i], GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, oitBuffers[i], 0);
+    }
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Framebuffer not complete!" << std::endl;
+
+    // Bloom composite, read back by the sharpen pass
+    //----------------------------------------------------------
+    glGenFramebuffers(1, &effectFBO);
+    glGenTextures(1, &effectColorBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, effectFBO);
+    glBindTexture(GL_TEXTURE_2D, effectColorBuffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, internalWidth, internalHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, effectColorBuffer, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Framebuffer not complete!" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the bindings above went around the state cache, and deleted ids may have been handed out again
+    GLState::get().invalidate();
+}
+
+void RenderTargets::release()
+{
+    glDeleteFramebuffers(1, &hdrFBO);
+    glDeleteTextures(2, colorBuffers);
+    glDeleteFramebuffers(1, &oitFBO);
+    glDeleteTextures(2, oitBuffers);
+    glDeleteRenderbuffers(1, &rboDepth);
+    glDeleteFramebuffers(1, &effectFBO);
+    glDeleteTextures(1, &effectColorBuffer);
+}
+
+DynamicResolution::DynamicResolution()
+{
+    enabled = false;
+    budgetMs = 16.0f;
+    minScale = 0.5f;
+    maxScale = 1.0f;
+    step = 0.05f;
+    averageMs = -1.0;
+    lastFrameIndex = ~0ul;
+    cooldown = 0;
+}
+
+float DynamicResolution::update(const Profiler::FrameTiming &frame, float scale)
+{
+    // only frames with new GPU timings count
+    if (!enabled || frame.index == lastFrameIndex || frame.gpuMs <= 0.0)
+        return scale;
+    lastFrameIndex = frame.index;
+
+    if (cooldown > 0) {
+        cooldown--;
+        return scale;
+    }
+    averageMs = averageMs < 0.0 ? frame.gpuMs : averageMs * 0.9 + frame.gpuMs * 0.1;
+
+    float target = scale;
+    if (averageMs > budgetMs)
+        target = std::min(scale * (float)std::sqrt(budgetMs / averageMs), scale - step);
+    else if (averageMs < budgetMs * 0.75f)
+        target = scale + step;
+    target = std::max(minScale, std::min(std::floor(target / step + 0.5f) * step, maxScale));
+    if (std::fabs(target - scale) < step * 0.5f)
+        return scale;
+
+    // timings of the frames still in flight were taken at the old scale
+    cooldown = Profiler::QUERY_FRAMES + 4;
+    averageMs = -1.0;
+    return target;
+}
@@ -0,0 +1,88 @@
+#ifndef RENDERTARGETS_H
+#define RENDERTARGETS_H
+
+#include "bloom.h"
+#include "profiler.h"
+
+// Offscreen targets of a frame: the HDR scene (color, bright color and depth), the weighted blended
+// transparency targets, the bloom composite read by the sharpen pass and the bloom blur targets. They are rendered at the internal resolution,
+// the output (window framebuffer) size times the render scale, and reallocated whenever either changes.
+// The final pass draws at the output size and upsamples them with bilinear filtering.
+class RenderTargets {
+public:
+    static constexpr float MIN_SCALE = 0.25f;
+    static constexpr float MAX_SCALE = 2.0f;
+
+    RenderTargets(unsigned int outputWidth, unsigned int outputHeight);
+    ~RenderTargets();
+    RenderTargets(const RenderTargets&) = delete;
+    RenderTargets& operator=(const RenderTargets&) = delete;
+
+    // a 0 size (minimized window) is ignored, the targets keep their last size
+    void setOutputSize(unsigned int width, unsigned int height);
+    // clamped to [MIN_SCALE, MAX_SCALE]
+    void setRenderScale(float scale);
+
+    float renderScale() const { return scale; }
+    unsigned int width() const { return internalWidth; }
+    unsigned int height() const { return internalHeight; }
+    unsigned int outputWidth() const { return outWidth; }
+    unsigned int outputHeight() const { return outHeight; }
+    // of the output, for the projection
+    float aspectRatio() const { return (float)outWidth / (float)outHeight; }
+    // times the targets were reallocated after the first allocation
+    unsigned int reallocations() const { return reallocationCount; }
+
+    unsigned int hdrFBO;
+    // scene color and bright color
+    unsigned int colorBuffers[2];
+    // weighted blended transparency, depth tested against the HDR depth buffer:
+    // premultiplied color * weight with the revealage in alpha, and the sum of alpha * weight
+    unsigned int oitFBO;
+    unsigned int oitBuffers[2];
+    unsigned int effectFBO;
+    unsigned int effectColorBuffer;
+    Bloom bloom;
+
+private:
+    void allocate();
+    void release();
+    // reallocates if the internal resolution changed
+    void update();
+
+    float scale;
+    unsigned int outWidth;
+    unsigned int outHeight;
+    unsigned int internalWidth;
+    unsigned int internalHeight;
+    unsigned int rboDepth;
+    unsigned int reallocationCount;
+};
+
+// Picks the render scale from the measured GPU frame time. Over budgetMs the scale drops right away,
+// by the square root of the overshoot since the cost of the fragment bound passes grows with the pixel
+// count. Well under the budget it climbs back one step at a time. GPU timings arrive
+// Profiler::QUERY_FRAMES frames late, so after a change it waits for frames measured at the new scale.
+class DynamicResolution {
+public:
+    DynamicResolution();
+
+    // returns the render scale for the next frame
+    float update(const Profiler::FrameTiming &frame, float scale);
+
+    bool enabled;
+    float budgetMs;
+    float minScale;
+    float maxScale;
+    // scales are multiples of step, so small timing jitter doesn't reallocate the targets
+    float step;
+    // smoothed GPU frame time the decisions are based on
+    double averageMs;
+
+private:
+    unsigned long lastFrameIndex;
+    unsigned int cooldown;
+};
+
+
+#endif //RENDERTARGETS_H
@@ -4,56 +4,178 @@
 
 #include "renderer.h"
 #include "utilities.h"
+#include "pointShadows.h"
 
 Renderer::Renderer()
 {
     quadVAO = 0;
     cubeVAO = 0;
     cubeVBO = 0;
+    frustumCulling = true;
+    shadowCasters = nullptr;
 }
 
-unsigned int Renderer::loadTexture(char const * path, bool gammaCorrection)
+void Renderer::beginFrame(const glm::mat4 &projection, const glm::mat4 &view)
+{
+    frustum = Frustum(projection * view);
+    cullStats = CullStats();
+    queue.begin(glm::vec3(glm::inverse(view)[3]));
+}
+
+void Renderer::drawModel(Shader &shader, Model &model, const glm::mat4 &modelMatrix, bool cullFace,
+                         RenderQueue::Pass pass, unsigned int baseTexture)
+{
+    auto submit = [&](Mesh &mesh) {
+        DrawPacket &packet = queue.submit(pass, shader, mesh.VAO, mesh.indexCount, modelMatrix);
+        packet.indexed = true;
+        packet.baseVertex = mesh.baseVertex();
+        packet.firstIndex = mesh.firstIndex();
+        packet.indexType = mesh.indexType;
+        packet.cullFace = cullFace;
+        packet.samplerMesh = &mesh;
+        packet.positionScale = mesh.positionScale;
+        packet.positionOffset = mesh.positionOffset;
+        // the pre-pass reads the position only stream
+        if(packet.depthVao != 0)
+            packet.depthVao = mesh.positionVAO;
+        if(baseTexture != 0)
+            packet.setTextures({baseTexture});
+        // the mesh's own textures take the units from 0 up, like Mesh::Draw binding over baseTexture
+        for(unsigned int i = 0; i < mesh.textures.size() && i < DrawPacket::MAX_TEXTURES; i++)
+            packet.textures[i] = mesh.textures[i].id;
+        packet.textureCount = std::max(packet.textureCount, (unsigned int)std::min(mesh.textures.size(), (size_t)DrawPacket::MAX_TEXTURES));
+    };
+
+    // casters are not culled against the camera, they can shadow what the camera sees from outside of it
+    if(shadowCasters != nullptr && pass == RenderQueue::OPAQUE_PASS)
+        shadowCasters->addModel(model, modelMatrix);
+
+    if(frustumCulling)
+        model.ForEachVisibleMesh(modelMatrix, frustum, cullStats, submit);
+    else{
+        for(Mesh &mesh : model.meshes)
+            submit(mesh);
+        cullStats.drawn += model.meshes.size();
+    }
+}
+
+unsigned int Renderer::loadTexture(char const * path, bool gammaCorrection, bool flip)
+{
+    ImageData image = DecodeImage(path, flip);
+    return uploadTexture(image, path, gammaCorrection);
+}
+
+unsigned int Renderer::uploadTexture(ImageData &image, char const * path, bool gammaCorrection)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
         GLenum internalFormat;
         GLenum dataFormat;
-        if (nrComponents == 1)
+        if (image.nrComponents == 1)
         {
             internalFormat = dataFormat = GL_RED;
         }
-        else if (nrComponents == 3)
+        else if (image.nrComponents == 3)
         {
             internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
             dataFormat = GL_RGB;
         }
-        else if (nrComponents == 4)
+        else if (image.nrComponents == 4)
         {
             internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
             dataFormat = GL_RGBA;
         }
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, dataFormat, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else
     {
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
+    stbi_image_free(image.data);
+    image.data = nullptr;
+
+    return textureID;
+}
+
+unsigned int Renderer::textureArray(const std::vector<unsigned int> &textures, unsigned int size)
+{
+    unsigned int arrayID;
+    glGenTextures(1, &arrayID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_SRGB8_ALPHA8, size, size, textures.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    // every layer is a scaled blit of a texture, they stay on the GPU
+    unsigned int framebuffers[2];
+    glGenFramebuffers(2, framebuffers);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+    for (unsigned int layer = 0; layer < textures.size(); layer++)
+    {
+        int width = 0, height = 0;
+        glBindTexture(GL_TEXTURE_2D, textures[layer]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[layer], 0);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, arrayID, 0, layer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(2, framebuffers);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayID);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLState::get().invalidate();
+
+    return arrayID;
+}
+
+unsigned int Renderer::loadCubemap(const std::vector<std::string> &faces)
+{
+    std::vector<ImageData> images;
+    for (const std::string &face : faces)
+        images.push_back(DecodeImage(face));
+    return uploadCubemap(images, faces);
+}
+
+unsigned int Renderer::uploadCubemap(std::vector<ImageData> &faces, const std::vector<std::string> &paths)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+        if (faces[i].data)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, faces[i].width, faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].data);
+        }
+        else
+        {
+            std::cout << "Cubemap texture failed to load at path: " << paths[i] << std::endl;
+        }
+        stbi_image_free(faces[i].data);
+        faces[i].data = nullptr;
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
     return textureID;
 }
@@ -72,7 +194,7 @@ void Renderer::renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        GLState::get().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -80,12 +202,11 @@ void Renderer::renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::get().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 
-void Renderer::renderCube()
+unsigned int Renderer::cubeVertexArray()
 {
     // initialize (if necessary)
     if (cubeVAO == 0)
@@ -141,7 +262,7 @@ void Renderer::renderCube()
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState::get().bindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -149,32 +270,30 @@ void Renderer::renderCube()
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
     }
-    // render Cube
-    glBindVertexArray(cubeVAO);
+    return cubeVAO;
+}
+
+void Renderer::renderCube()
+{
+    GLState::get().bindVertexArray(cubeVertexArray());
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
 }
 
 
-void Renderer::renderMario(Shader &shader, Model &marioModel, glm::vec3 position, float angle){
+void Renderer::renderMario(Shader &shader, Model &marioModel, glm::vec3 position, float angle, unsigned int texture){
     glm::mat4 modelMario = glm::mat4(1.0f);
     modelMario = glm::translate(modelMario, position);
     modelMario = glm::rotate(modelMario, glm::radians(angle - 180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
     modelMario = glm::scale(modelMario, glm::vec3(0.4f));
-    shader.setMat4("model", modelMario);
-    marioModel.Draw(shader);
+    drawModel(shader, marioModel, modelMario, false, RenderQueue::OPAQUE_PASS, texture);
 }
 
 void Renderer::renderRoomPipe(Shader &shader, Model &pipeModel){
     glm::mat4 modelPipe = glm::mat4(1.0f);
     modelPipe = glm::translate(modelPipe, glm::vec3(9.0f, -5.0f, 0.0f));
     modelPipe = glm::scale(modelPipe, glm::vec3(0.5f, 0.5f, 0.5f));
-    shader.setMat4("model", modelPipe);
-    glDisable(GL_CULL_FACE);
-    pipeModel.Draw(shader);
-    glEnable(GL_CULL_FACE);
+    drawModel(shader, pipeModel, modelPipe, false);
 }
 
 void Renderer::renderStar(Shader &shader, Model &starModel){
@@ -182,8 +301,7 @@ void Renderer::renderStar(Shader &shader, Model &starModel){
     modelStar = glm::translate(modelStar, glm::vec3(20.0f, -6.5f, 3.0f));
     //modelStar = glm::rotate(modelStar,(float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
     modelStar = glm::scale(modelStar, glm::vec3(5.0f, 5.0f, 5.0f));
-    shader.setMat4("model", modelStar);
-    starModel.Draw(shader);
+    drawModel(shader, starModel, modelStar, false);
 }
 
 void Renderer::renderMushroom(Shader& shader, Model &mushroomModel, float height){
@@ -191,32 +309,28 @@ void Renderer::renderMushroom(Shader& shader, Model &mushroomModel, float height
     modelMushroom = glm::translate(modelMushroom, glm::vec3(-5.0f, -0.3f + height, 0.0f));
     modelMushroom = glm::rotate(modelMushroom, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
     modelMushroom = glm::scale(modelMushroom, glm::vec3(0.3f));
-    shader.setMat4("model", modelMushroom);
-    mushroomModel.Draw(shader);
+    drawModel(shader, mushroomModel, modelMushroom, false);
 }
 
 void Renderer::renderShip(Shader &shader, Model &shipModel){
     glm::mat4 modelShip = glm::mat4(1.0f);
     modelShip = glm::translate(modelShip, glm::vec3(-18.0f, 0.0f, 0.0f));
     modelShip = glm::scale(modelShip, glm::vec3(10.0f));
-    shader.setMat4("model", modelShip);
-    shipModel.Draw(shader);
+    drawModel(shader, shipModel, modelShip, false);
 }
 
 void Renderer::renderPipe(Shader &shader, Model &pipeModel){
     glm::mat4 modelPipe = glm::mat4(1.0f);
     modelPipe = glm::translate(modelPipe, glm::vec3(-5.9f, -3.6f, -3.0f));
     modelPipe = glm::scale(modelPipe, glm::vec3(0.5f));
-    shader.setMat4("model", modelPipe);
-    pipeModel.Draw(shader);
+    drawModel(shader, pipeModel, modelPipe, false);
 }
 
 void Renderer::renderIsland(Shader &shader, Model &islandModel){
     glm::mat4 modelIsland = glm::mat4(1.0f);
     modelIsland = glm::translate(modelIsland, glm::vec3 (0.0f, 0.0f, 0.0f));
     modelIsland = glm::scale(modelIsland, glm::vec3(10.0f));
-    shader.setMat4("model", modelIsland);
-    islandModel.Draw(shader);
+    drawModel(shader, islandModel, modelIsland, false);
 }
 
 void Renderer::renderGhost(Shader &shader, Model &ghostModel, glm::vec3 position, float angle){
@@ -224,8 +338,7 @@ void Renderer::renderGhost(Shader &shader, Model &ghostModel, glm::vec3 position
     modelGhost = glm::translate(modelGhost, position);
     modelGhost = glm::rotate(modelGhost, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
     modelGhost = glm::scale(modelGhost, glm::vec3(0.003f));
-    shader.setMat4("model", modelGhost);
-    ghostModel.Draw(shader);
+    drawModel(shader, ghostModel, modelGhost, false);
 }
 
 void Renderer::renderYellowStar(Shader &shader, Model &yellowStarModel){
@@ -235,8 +348,7 @@ void Renderer::renderYellowStar(Shader &shader, Model &yellowStarModel){
     model = glm::translate(model, glm::vec3(-4.0f, 2.3f, -5.0f));
     model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
     model = glm::scale(model, glm::vec3(4.0f));
-    shader.setMat4("model", model);
-    yellowStarModel.Draw(shader);
+    drawModel(shader, yellowStarModel, model, false);
 }
 
 void Renderer::renderBlueStar(Shader &shader, Model &blueStarModel){
@@ -244,8 +356,7 @@ void Renderer::renderBlueStar(Shader &shader, Model &blueStarModel){
     model = glm::translate(model, glm::vec3(5.0f, -3.0f, 3.0f));
     model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
     model = glm::scale(model, glm::vec3(4.0f));
-    shader.setMat4("model", model);
-    blueStarModel.Draw(shader);
+    drawModel(shader, blueStarModel, model, false);
 }
 
 void Renderer::renderRedStar(Shader &shader, Model &redStarModel){
@@ -253,30 +364,35 @@ void Renderer::renderRedStar(Shader &shader, Model &redStarModel){
     model = glm::translate(model, glm::vec3(-14.5f, 10.0f, -0.8f));
     model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
     model = glm::scale(model, glm::vec3(6.0f));
-    shader.setMat4("model", model);
-    redStarModel.Draw(shader);
+    drawModel(shader, redStarModel, model, false);
 }
 
-void Renderer::renderRoomScene(Shader &shader){
+void Renderer::renderRoomScene(Shader &shader, unsigned int texture){
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(20.0f, 0.0f, 0.0f));
     model = glm::scale(model, glm::vec3(10.0f, 5.0f, 7.0f));
-    shader.setMat4("model", model);
-    glDisable(GL_CULL_FACE);
-    shader.setInt("inverse_normals", 1);
-    renderCube();
-    shader.setInt("inverse_normals", 0);
-    glEnable(GL_CULL_FACE);
+    // the room is seen from inside
+    DrawPacket &room = queue.submit(RenderQueue::OPAQUE_PASS, shader, cubeVertexArray(), 36, model);
+    room.setTextures({texture});
+    room.cullFace = false;
+    room.intUniform = "inverse_normals";
+    room.intValue = 1;
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(18.0f + 6*sin(glfwGetTime()), 0.0f, 1.0));
     model = glm::scale(model, glm::vec3(0.75f));
-    shader.setMat4("model", model);
-    renderCube();
+    DrawPacket &firstCube = queue.submit(RenderQueue::OPAQUE_PASS, shader, cubeVertexArray(), 36, model);
+    firstCube.setTextures({texture});
+    firstCube.intUniform = "inverse_normals";
+    if(shadowCasters != nullptr)
+        shadowCasters->addCaster(cubeVertexArray(), 36, false, model, Bounds::fromBox(glm::vec3(-1.0f), glm::vec3(1.0f)));
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(18.0f - 6*sin(glfwGetTime()), 0.0f, 4.0));
     model = glm::scale(model, glm::vec3(0.75f));
-    shader.setMat4("model", model);
-    renderCube();
-}
\ No newline at end of file
+    DrawPacket &secondCube = queue.submit(RenderQueue::OPAQUE_PASS, shader, cubeVertexArray(), 36, model);
+    secondCube.setTextures({texture});
+    secondCube.intUniform = "inverse_normals";
+    if(shadowCasters != nullptr)
+        shadowCasters->addCaster(cubeVertexArray(), 36, false, model, Bounds::fromBox(glm::vec3(-1.0f), glm::vec3(1.0f)));
+}
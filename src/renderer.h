@@ -9,6 +9,10 @@
 #include <learnopengl/model.h>
 #include <GLFW/glfw3.h>
 
+#include "renderQueue.h"
+
+class PointShadows;
+
 class Renderer {
 
 private:
@@ -24,13 +28,33 @@ public:
     unsigned int cubeVAO;
     unsigned int cubeVBO;
 
-    unsigned int static loadTexture(char const * path, bool gammaCorrection);
+    // Frustum culling of model draws, the frustum and counters are reset by beginFrame
+    bool frustumCulling;
+    Frustum frustum;
+    CullStats cullStats;
+    // render* functions only submit packets, they are drawn by queue.execute()
+    RenderQueue queue;
+    // when set, opaque model draws are also added as shadow casters of the current light
+    PointShadows *shadowCasters;
+    void beginFrame(const glm::mat4 &projection, const glm::mat4 &view);
+    // submits a packet for every visible mesh. baseTexture is bound to unit 0 for meshes without textures.
+    // The imported models are all drawn with cullFace false, some of them are open or single sided.
+    void drawModel(Shader &shader, Model &model, const glm::mat4 &modelMatrix, bool cullFace = true,
+                   RenderQueue::Pass pass = RenderQueue::OPAQUE_PASS, unsigned int baseTexture = 0);
+
+    unsigned int static loadTexture(char const * path, bool gammaCorrection, bool flip = false);
+    unsigned int static uploadTexture(ImageData &image, char const * path, bool gammaCorrection);
+    // copies 2D textures into the layers of a size x size sRGB texture array, scaled with linear filtering
+    unsigned int static textureArray(const std::vector<unsigned int> &textures, unsigned int size);
+    unsigned int static loadCubemap(const std::vector<std::string> &faces);
+    unsigned int static uploadCubemap(std::vector<ImageData> &faces, const std::vector<std::string> &paths);
 
     void renderQuad();
     void renderCube();
-    void renderMario(Shader &shader, Model &marioModel, glm::vec3 position, float angle);
+    unsigned int cubeVertexArray();
+    void renderMario(Shader &shader, Model &marioModel, glm::vec3 position, float angle, unsigned int texture);
     void renderGhost(Shader &shader, Model &ghostModel, glm::vec3 position, float angle);
-    void renderRoomScene(Shader &shader);
+    void renderRoomScene(Shader &shader, unsigned int texture);
     void renderRoomPipe(Shader &shader, Model &pipeModel);
     void renderPipe(Shader& shader, Model &pipeModel);
     void renderStar(Shader& shader, Model &starModel);
@@ -7,8 +7,10 @@
 #include <GLFW/glfw3.h>
 #include <ctime>
 #include <cstdlib>
+#include <random>
 
 #include "character.h"
+#include "clusteredLights.h"
 
 Scene::Scene()
 {
@@ -38,84 +40,115 @@ Scene::Scene()
 
     std::srand(std::time(nullptr));
     boxColor = (Utilities::enumColor)(std::rand() % 5 + 1);
+
+    previousMushroomHeight = mushroomHeight;
+    previousBoxPosition = transparentBoxPosition;
 }
 
-void Scene::setLights(Shader &shader, ProgramState *programState){
-    shader.setVec3("light.position", lightPos);
-    shader.setVec3("viewPos", programState->camera.Position);
+void Scene::updateLights(FrameUniforms &frameUniforms, ProgramState *programState){
+    FrameUniforms::LightsBlock &lights = frameUniforms.lights;
 
     // directional light
-    shader.setVec3("dirLight.direction", 1.0f, -1.0, 0.0f);
-    shader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-    shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+    lights.dirLight.direction = glm::vec3(1.0f, -1.0, 0.0f);
+    lights.dirLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    lights.dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    lights.dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
     // pointlight properties
-    shader.setVec3("pointLights[0].position", lightPos);
-    shader.setVec3("pointLights[0].ambient", 0.1f, 0.1f, 0.1f);
-    shader.setVec3("pointLights[0].diffuse", 0.6f, 0.6f, 0.6f);
-    shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-
-    shader.setFloat("pointLights[0].constant", 1.0f);
-    shader.setFloat("pointLights[0].linear", 0.09f);
-    shader.setFloat("pointLights[0].quadratic", 0.032f);
+    lights.pointLights[0].position = lightPos;
+    lights.pointLights[0].ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.pointLights[0].diffuse = glm::vec3(0.6f, 0.6f, 0.6f);
+    lights.pointLights[0].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.pointLights[0].constant = 1.0f;
+    lights.pointLights[0].linear = 0.09f;
+    lights.pointLights[0].quadratic = 0.032f;
     // spotLight
-    shader.setVec3("spotLight.position", programState->camera.Position);
-    shader.setVec3("spotLight.direction", programState->camera.Front);
-    shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    shader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-    shader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("spotLight.constant", 1.0f);
-    shader.setFloat("spotLight.linear", 0.09f);
-    shader.setFloat("spotLight.quadratic", 0.032f);
-    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-    if(!spotlightOn){
-        shader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-        shader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
+    lights.spotLight.position = programState->camera.Position;
+    lights.spotLight.direction = programState->camera.Front;
+    lights.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    if(spotlightOn){
+        lights.spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+        lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    }
+    else{
+        lights.spotLight.diffuse = glm::vec3(0.0f, 0.0f, 0.0f);
+        lights.spotLight.specular = glm::vec3(0.0f, 0.0f, 0.0f);
     }
+    lights.spotLight.constant = 1.0f;
+    lights.spotLight.linear = 0.09f;
+    lights.spotLight.quadratic = 0.032f;
+    lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+    lights.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+    // hidden room light
+    lights.roomLight.position = roomLightPosition;
+    lights.roomLight.color = roomLightColor;
 }
 
-void Scene::coinSetLights(Shader &shader, ProgramState *programState){
-    shader.setVec3("pointLight.position", lightPos);
-    shader.setVec3("pointLight.ambient", 0.1f, 0.1f, 0.1f);
-    shader.setVec3("pointLight.diffuse", 0.6f, 0.6f, 0.6f);
-    shader.setVec3("pointLight.specular", 1.0f, 1.0f, 1.0f);
-    shader.setFloat("pointLight.constant", 1.0f);
-    shader.setFloat("pointLight.linear", 0.09f);
-    shader.setFloat("pointLight.quadratic", 0.032f);
-
-    shader.setVec3("lightPos", lightPos);
-    shader.setVec3("viewPos", programState->camera.Position);
-
-    shader.setVec3("dirlight.direction", 1.0f, -1.0, 0.0f);
-    shader.setVec3("dirlight.ambient", 0.05f, 0.05f, 0.05f);
-    shader.setVec3("dirlight.diffuse", 0.4f, 0.4f, 0.4f);
-    shader.setVec3("dirlight.specular", 0.5f, 0.5f, 0.5f);
-
+void Scene::coinSetLights(Shader &shader){
     shader.setVec3("spotlight.ambient", 0.5f, 0.5f, 0.5f);
     shader.setVec3("spotlight.diffuse", 1.0f, 1.0f, 1.0f);
     shader.setVec3("spotlight.specular", 1.0f, 1.0f, 1.0f);
     shader.setFloat("spotlight.constant", 1.0f);
     shader.setFloat("spotlight.linear", 0.09f);
     shader.setFloat("spotlight.quadratic", 0.032f);
-    shader.setVec3("spotlight.position", programState->camera.Position);
-    shader.setVec3("spotlight.direction", programState->camera.Front);
     shader.setFloat("spotlight.cutOff", glm::cos(glm::radians(12.5f)));
     shader.setFloat("spotlight.outerCutOff", glm::cos(glm::radians(15.0f)));
+}
 
+void Scene::addPointLights(ClusteredLights &clusteredLights){
+    // same light as pointLights[0] of the lights block
+    clusteredLights.add(lightPos, glm::vec3(0.1f), glm::vec3(0.6f), glm::vec3(1.0f), 1.0f, 0.09f, 0.032f);
+
+    // stars glow in their own color until they are caught
+    if(!yellowStarCatched)
+        clusteredLights.add(glm::vec3(-4.0f, 2.3f, -5.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.9f, 0.2f),
+                            glm::vec3(1.0f, 0.9f, 0.2f), 1.0f, 0.35f, 0.44f);
+    if(!blueStarCatched)
+        clusteredLights.add(glm::vec3(5.0f, -3.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.2f, 0.4f, 1.0f),
+                            glm::vec3(0.2f, 0.4f, 1.0f), 1.0f, 0.35f, 0.44f);
+    if(!redStarCatched)
+        clusteredLights.add(glm::vec3(-14.5f, 10.0f, -0.8f), glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.1f),
+                            glm::vec3(1.0f, 0.2f, 0.1f), 1.0f, 0.35f, 0.44f);
+    if(inside && !starCatched)
+        clusteredLights.add(glm::vec3(20.0f, -6.5f, 3.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.9f, 0.2f),
+                            glm::vec3(1.0f, 0.9f, 0.2f), 1.0f, 0.35f, 0.44f);
+
+    // a faint golden glow above every coin
+    for(const glm::vec3 &coin : coinPositions)
+        clusteredLights.add(coin + glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f), glm::vec3(0.5f, 0.4f, 0.1f),
+                            glm::vec3(0.5f, 0.4f, 0.1f), 1.0f, 0.7f, 1.8f);
+
+    for(const std::pair<glm::vec3, glm::vec3> &light : scatteredLights)
+        clusteredLights.add(light.first, glm::vec3(0.0f), light.second, light.second, 1.0f, 0.7f, 1.8f);
+}
+
+void Scene::scatterLights(unsigned int count){
+    // own generator with a fixed seed, every run gets the same lights and the global rand() is left alone
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> angle(0.0f, glm::radians(360.0f));
+    std::uniform_real_distribution<float> distance(2.0f, 12.0f);
+    std::uniform_real_distribution<float> height(-4.0f, 6.0f);
+    // lava colors, orange to red
+    std::uniform_real_distribution<float> green(0.0f, 0.5f);
+    scatteredLights.clear();
+    for(unsigned int i = 0; i < count; i++){
+        float a = angle(rng);
+        float d = distance(rng);
+        glm::vec3 position(-5.0f + d * glm::cos(a), height(rng), d * glm::sin(a));
+        glm::vec3 color(1.0f, green(rng), 0.0f);
+        scatteredLights.push_back({position, color});
+    }
 }
 
 void Scene::roomCheck(Character &character, ProgramState *programState){
     if(character.isOnPoint(-1.6f,-8.2f, 0.6f && character.currentCharacter == Character::mario)){
-        character.characterPosition = glm::vec3 (14.3f, -4.5f, -4.77f);
+        character.teleport(glm::vec3 (14.3f, -4.5f, -4.77f));
         programState->camera.Position = glm::vec3(29.67f, -0.11f, -5.66f);
         programState->camera.Front = glm::vec3(-0.91f, -0.18f, 0.35f);
         inside = true;
     }
 
     if(character.isOnPoint(13.8f, -5.1f, 0.6f && character.currentCharacter == Character::mario) && starCatched){
-        character.characterPosition = glm::vec3 (-3.57f, -3.0f, -7.71f);
+        character.teleport(glm::vec3 (-3.57f, -3.0f, -7.71f));
         programState->camera.Position = glm::vec3(-12.17f, 0.5f, -17.0f);
         programState->camera.Front = glm::vec3(0.6f, -0.1f, 0.78f);
         starCatched = false;
@@ -190,4 +223,17 @@ void Scene::boxCheck(Character &character){
         if(character.characterPosition.y <= -3.0f)
             boxFalling = false;
     }
-}
\ No newline at end of file
+}
+
+void Scene::beginTick(){
+    previousMushroomHeight = mushroomHeight;
+    previousBoxPosition = transparentBoxPosition;
+}
+
+float Scene::interpolatedMushroomHeight(float alpha) const{
+    return glm::mix(previousMushroomHeight, mushroomHeight, alpha);
+}
+
+glm::vec3 Scene::interpolatedBoxPosition(float alpha) const{
+    return glm::mix(previousBoxPosition, transparentBoxPosition, alpha);
+}
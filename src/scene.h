@@ -7,10 +7,14 @@
 
 #include <glm/vec3.hpp>
 
+#include <vector>
+
 #include "programState.h"
+#include "frameUniforms.h"
 #include "utilities.h"
 
 class Character;
+class ClusteredLights;
 
 class Scene {
 public:
@@ -23,8 +27,16 @@ public:
     glm::vec3 roomLightColor;
     bool spotlightOn;
 
-    void setLights(Shader &shader, ProgramState *programState);
-    void coinSetLights(Shader &shader, ProgramState *programState);
+    // Fills the shared lights block, uploaded once per frame by FrameUniforms
+    void updateLights(FrameUniforms &frameUniforms, ProgramState *programState);
+    // Coin spotlight constants, set once after the coin shader is compiled
+    void coinSetLights(Shader &shader);
+    // Point lights of the clustered shading, the island light first since it is the one with shadows
+    void addPointLights(ClusteredLights &clusteredLights);
+    // Small lights scattered over the island, to load the clustered shading
+    void scatterLights(unsigned int count);
+    std::vector<glm::vec3> coinPositions;
+    std::vector<std::pair<glm::vec3, glm::vec3> > scatteredLights;
 
 
     // Is character in the hidden room
@@ -52,6 +64,13 @@ public:
     bool boxFalling;
     glm::vec3 transparentBoxPosition;
     Utilities::enumColor boxColor;
+
+    // saves the mushroom height and box position before the tick moves them
+    void beginTick();
+    float interpolatedMushroomHeight(float alpha) const;
+    glm::vec3 interpolatedBoxPosition(float alpha) const;
+    float previousMushroomHeight;
+    glm::vec3 previousBoxPosition;
 };
 
 